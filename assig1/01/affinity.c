@@ -0,0 +1,150 @@
+#define _GNU_SOURCE
+#include "affinity.h"
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int node_of[MAX_CPUS]; // NUMA node of each CPU
+static int nodes_c = 0;       // 0 until the topology is loaded
+
+/**
+ * @brief Parses a CPU list in the sysfs format (e.g. 0-3,8,10-11).
+ *
+ * @return The number of CPUs stored in cpus, or -1 if the list is malformed.
+ */
+static int parseCpuList(const char *str, int *cpus, int max) {
+  int n = 0;
+  const char *p = str;
+
+  while (*p != '\0' && *p != '\n') {
+    char *end;
+    long first = strtol(p, &end, 10);
+    long last = first;
+    if (end == p || first < 0 || first >= MAX_CPUS)
+      return -1;
+    if (*end == '-') {
+      p = end + 1;
+      last = strtol(p, &end, 10);
+      if (end == p || last < first || last >= MAX_CPUS)
+        return -1;
+    }
+    for (long cpu = first; cpu <= last && n < max; cpu++) {
+      cpus[n++] = (int)cpu;
+    }
+    p = end;
+    if (*p == ',')
+      p++;
+    else if (*p != '\0' && *p != '\n')
+      return -1;
+  }
+  return n;
+}
+
+/**
+ * @brief Reads the CPU to NUMA node map from sysfs, all CPUs go to node 0 if it is not available.
+ */
+static void loadTopology(void) {
+  if (nodes_c != 0)
+    return;
+
+  memset(node_of, 0, sizeof(node_of));
+  nodes_c = 1;
+
+  char path[64], line[4096];
+  int cpus[MAX_CPUS];
+  for (int node = 0; node < MAX_NODES; node++) {
+    snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+    FILE *fd = fopen(path, "r");
+    if (fd == NULL)
+      continue; // node ids may have holes
+    if (fgets(line, sizeof(line), fd) != NULL) {
+      int n = parseCpuList(line, cpus, MAX_CPUS);
+      for (int i = 0; i < n; i++) {
+        node_of[cpus[i]] = node;
+      }
+      if (n > 0 && node + 1 > nodes_c)
+        nodes_c = node + 1;
+    }
+    fclose(fd);
+  }
+}
+
+int cpuNode(int cpu) {
+  loadTopology();
+  return cpu >= 0 && cpu < MAX_CPUS ? node_of[cpu] : 0;
+}
+
+int nodeCount(void) {
+  loadTopology();
+  return nodes_c;
+}
+
+int parseAffinity(char *arg, struct affinity *aff) {
+  cpu_set_t allowed;
+  int online[MAX_CPUS], online_c = 0;
+
+  loadTopology();
+  aff->cpus_c = 0;
+
+  // only the CPUs this process is allowed to run on are considered
+  CPU_ZERO(&allowed);
+  if (sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+    perror("sched_getaffinity");
+    return -1;
+  }
+  for (int cpu = 0; cpu < MAX_CPUS && cpu < CPU_SETSIZE; cpu++) {
+    if (CPU_ISSET(cpu, &allowed))
+      online[online_c++] = cpu;
+  }
+
+  if (strcmp(arg, "compact") == 0) {
+    aff->policy = AFFINITY_COMPACT;
+    for (int node = 0; node < nodes_c; node++) {
+      for (int i = 0; i < online_c; i++) {
+        if (node_of[online[i]] == node)
+          aff->cpus[aff->cpus_c++] = online[i];
+      }
+    }
+
+  } else if (strcmp(arg, "scatter") == 0) {
+    aff->policy = AFFINITY_SCATTER;
+    int taken[MAX_NODES] = {0}; // CPUs already placed from each node
+    while (aff->cpus_c < online_c) {
+      for (int node = 0; node < nodes_c; node++) {
+        // take the next unplaced CPU of this node
+        int seen = 0;
+        for (int i = 0; i < online_c; i++) {
+          if (node_of[online[i]] != node)
+            continue;
+          if (seen++ == taken[node]) {
+            aff->cpus[aff->cpus_c++] = online[i];
+            taken[node]++;
+            break;
+          }
+        }
+      }
+    }
+
+  } else {
+    aff->policy = AFFINITY_LIST;
+    int n = parseCpuList(arg, aff->cpus, MAX_CPUS);
+    if (n <= 0)
+      return -1;
+    for (int i = 0; i < n; i++) {
+      if (!CPU_ISSET(aff->cpus[i], &allowed)) {
+        fprintf(stderr, "CPU %d is not available\n", aff->cpus[i]);
+        return -1;
+      }
+    }
+    aff->cpus_c = n;
+  }
+
+  return aff->cpus_c > 0 ? 0 : -1;
+}
+
+int affinityCpu(struct affinity *aff, int worker) {
+  if (aff->policy == AFFINITY_NONE || aff->cpus_c == 0)
+    return -1;
+  return aff->cpus[worker % aff->cpus_c];
+}
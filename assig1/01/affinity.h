@@ -0,0 +1,54 @@
+#ifndef AFFINITY_H
+#define AFFINITY_H
+
+#define MAX_CPUS 1024
+#define MAX_NODES 64
+
+/**
+ * @brief How the worker threads are placed on the CPUs.
+ */
+enum affinity_policy {
+  AFFINITY_NONE,    // default affinity, the scheduler decides
+  AFFINITY_COMPACT, // fill the CPUs of one NUMA node before moving to the next
+  AFFINITY_SCATTER, // round robin over the NUMA nodes
+  AFFINITY_LIST     // explicit CPU list, e.g. 0,2,8-11
+};
+
+/**
+ * @brief A placement policy resolved to the ordered list of CPUs the workers are pinned to.
+ */
+struct affinity {
+  enum affinity_policy policy;
+  int cpus_c;
+  int cpus[MAX_CPUS];
+};
+
+/**
+ * @brief Parses a placement policy ("compact", "scatter" or a CPU list).
+ *
+ * @param arg The policy given in the command line.
+ * @param aff The policy resolved against the CPUs this process may run on.
+ * @return 0 on success, -1 if the policy is invalid or selects no CPU.
+ */
+extern int parseAffinity(char *arg, struct affinity *aff);
+
+/**
+ * @brief Gives the CPU a worker should be pinned to.
+ *
+ * @param aff The placement policy.
+ * @param worker The worker id, workers beyond the CPU count wrap around.
+ * @return The CPU, or -1 if the worker is not pinned.
+ */
+extern int affinityCpu(struct affinity *aff, int worker);
+
+/**
+ * @brief Gives the NUMA node of a CPU (0 if the topology is not available).
+ */
+extern int cpuNode(int cpu);
+
+/**
+ * @brief Gives the number of NUMA nodes (1 if the topology is not available).
+ */
+extern int nodeCount(void);
+
+#endif
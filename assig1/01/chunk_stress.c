@@ -0,0 +1,266 @@
+/* USAGE:
+gcc -Wall -O3 -o chunk_stress chunk_stress.c
+./chunk_stress -n 200 -S ./utf8 -T ./utf8_threaded -M ../../assig2/part1/main
+
+Differential stress test of the chunk boundary handling of the counters.
+Every iteration generates a few random UTF-8 texts built to put words,
+accented letters, apostrophes and multi byte delimiters across chunk
+boundaries, counts them with the serial counter (the reference, one file at
+a time) and with the threaded and MPI counters using a random chunk size and
+thread/process count, and reports every file where the counts differ.
+*/
+#define _GNU_SOURCE
+#include <libgen.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_FILES 4
+#define MAX_FILE_SIZE (1 << 16)
+#define TIMEOUT 60 // seconds a counter may take before it is considered hung
+
+struct counts {
+  int words;
+  int consonants;
+};
+
+struct options {
+  int iterations;
+  unsigned seed;
+  int max_threads;
+  int max_procs;
+  int min_chunk;
+  int max_chunk;
+  char *serial;
+  char *threaded;
+  char *mpi;
+  char *launcher;
+  char *dir;
+};
+
+// pieces the texts are made of, weighted towards the ones that are hard to split
+static const char *word_pieces[] = {
+    "a", "b", "c", "s", "t", "r", "n", "l", "m", "p", "e", "i", "o", "u", "z", "x",
+    "A", "B", "S", "T", "Q", "0", "7", "_",
+    "\xC3\xA1", "\xC3\xA0", "\xC3\xA2", "\xC3\xA3", "\xC3\x81", "\xC3\xA9", "\xC3\xAA", "\xC3\x89",
+    "\xC3\xAD", "\xC3\xB3", "\xC3\xB5", "\xC3\x94", "\xC3\xBA", "\xC3\xB9", "\xC3\xA7", "\xC3\x87",
+    "'", "\xE2\x80\x98", "\xE2\x80\x99"};
+static const char *delimiter_pieces[] = {
+    " ", " ", " ", "\n", "\t", "\r\n", ".", ",", ";", ":", "!", "?", "-", "\"", "(", ")", "[", "]",
+    "\xE2\x80\xA6", "\xE2\x80\x93", "\xE2\x80\x9C", "\xE2\x80\x9D", "\xC2\xAB", "\xC2\xBB", "\xC2\xA0"};
+
+#define COUNT_OF(a) (sizeof(a) / sizeof((a)[0]))
+
+static void help(char *cmdName) {
+  fprintf(stderr, "Usage: %s [OPTIONS]\n"
+                  "OPTIONS:\n"
+                  "  -n      --- iterations (default 100)\n"
+                  "  -s      --- random seed (default time)\n"
+                  "  -t      --- maximum worker threads (default 8)\n"
+                  "  -p      --- maximum MPI processes (default 4)\n"
+                  "  -c      --- minimum chunk size in bytes (default 1)\n"
+                  "  -C      --- maximum chunk size in bytes (default 8192)\n"
+                  "  -S      --- serial counter (default ./utf8)\n"
+                  "  -T      --- threaded counter (default ./utf8_threaded)\n"
+                  "  -M      --- MPI counter, empty to skip it (default ../../assig2/part1/main)\n"
+                  "  -L      --- MPI launcher (default \"mpiexec --oversubscribe -n\")\n"
+                  "  -d      --- directory for the generated texts (default /tmp)\n"
+                  "  -h      --- print this help\n",
+          cmdName);
+}
+
+/*
+ * writes a random text of at most size bytes
+ * long words and runs of merger letters are frequent so that small chunks split them
+ * */
+static int generateText(char *path, int size) {
+  FILE *fd = fopen(path, "wb");
+  if (fd == NULL) {
+    perror(path);
+    return 1;
+  }
+
+  int written = 0;
+  while (written < size) {
+    int len = rand() % 4 == 0 ? rand() % 40 : rand() % 8;
+    for (int i = 0; i < len; i++) {
+      const char *piece = word_pieces[rand() % COUNT_OF(word_pieces)];
+      written += fprintf(fd, "%s", piece);
+    }
+    int delimiters = 1 + (rand() % 8 == 0 ? rand() % 6 : 0);
+    for (int i = 0; i < delimiters; i++) {
+      const char *piece = delimiter_pieces[rand() % COUNT_OF(delimiter_pieces)];
+      written += fprintf(fd, "%s", piece);
+    }
+  }
+  // sometimes end in the middle of a word
+  if (rand() % 2) {
+    fprintf(fd, "%s", word_pieces[rand() % COUNT_OF(word_pieces)]);
+  }
+
+  fclose(fd);
+  return 0;
+}
+
+/*
+ * reads the last number of a line ("...: 12" or "... = 12")
+ * */
+static int lineNumber(const char *line, int *value) {
+  const char *p = strrchr(line, ':');
+  const char *q = strrchr(line, '=');
+  if (q > p)
+    p = q;
+  if (p == NULL)
+    return 0;
+  return sscanf(p + 1, "%d", value) == 1;
+}
+
+/*
+ * runs a counter and sums the counts it prints for each file
+ * the serial counter only prints totals, those go to the file given in single
+ * returns !0 if the counter failed or did not finish in time
+ * */
+static int runCounter(char *cmd, char **files, int files_c, int single, struct counts *out) {
+  char line[1024];
+  int current = single;
+
+  memset(out, 0, files_c * sizeof(struct counts));
+  FILE *p = popen(cmd, "r");
+  if (p == NULL) {
+    perror("popen");
+    return 1;
+  }
+  while (fgets(line, sizeof(line), p) != NULL) {
+    int value;
+    if (strncasecmp(line, "File name:", 10) == 0) {
+      char *name = line + 10;
+      name += strspn(name, " ");
+      name[strcspn(name, "\r\n")] = '\0';
+      current = -1;
+      for (int i = 0; i < files_c; i++) {
+        if (strcmp(files[i], name) == 0)
+          current = i;
+      }
+    } else if (current >= 0 && strcasestr(line, "words") != NULL && lineNumber(line, &value)) {
+      if (strstr(line, "consonant") != NULL)
+        out[current].consonants += value;
+      else
+        out[current].words += value;
+    }
+  }
+  return pclose(p) != 0;
+}
+
+static int compare(const char *name, char **files, int files_c, struct counts *ref, struct counts *got, const char *cmd) {
+  int failed = 0;
+  for (int i = 0; i < files_c; i++) {
+    if (ref[i].words != got[i].words || ref[i].consonants != got[i].consonants) {
+      printf("MISMATCH %s on %s: words %d (expected %d), consonants %d (expected %d)\n  %s\n",
+             name, files[i], got[i].words, ref[i].words, got[i].consonants, ref[i].consonants, cmd);
+      failed = 1;
+    }
+  }
+  return failed;
+}
+
+int main(int argc, char *argv[]) {
+  struct options opt = {100, (unsigned)time(NULL), 8, 4, 1, 8192,
+                        "./utf8", "./utf8_threaded", "../../assig2/part1/main",
+                        "mpiexec --oversubscribe -n", "/tmp"};
+  int c;
+
+  while ((c = getopt(argc, argv, "n:s:t:p:c:C:S:T:M:L:d:h")) != -1) {
+    switch (c) {
+    case 'n': opt.iterations = atoi(optarg); break;
+    case 's': opt.seed = (unsigned)strtoul(optarg, NULL, 10); break;
+    case 't': opt.max_threads = atoi(optarg); break;
+    case 'p': opt.max_procs = atoi(optarg); break;
+    case 'c': opt.min_chunk = atoi(optarg); break;
+    case 'C': opt.max_chunk = atoi(optarg); break;
+    case 'S': opt.serial = optarg; break;
+    case 'T': opt.threaded = optarg; break;
+    case 'M': opt.mpi = optarg; break;
+    case 'L': opt.launcher = optarg; break;
+    case 'd': opt.dir = optarg; break;
+    case 'h':
+      help(basename(argv[0]));
+      return EXIT_SUCCESS;
+    default:
+      help(basename(argv[0]));
+      return EXIT_FAILURE;
+    }
+  }
+  if (opt.max_threads < 1 || opt.max_procs < 2 || opt.min_chunk < 1 || opt.max_chunk < opt.min_chunk) {
+    fprintf(stderr, "Invalid limits\n");
+    return EXIT_FAILURE;
+  }
+
+  printf("Seed: %u\n", opt.seed);
+  srand(opt.seed);
+
+  char paths[MAX_FILES][256];
+  char *files[MAX_FILES];
+  char cmd[4096];
+  struct counts ref[MAX_FILES], got[MAX_FILES];
+  int failures = 0;
+
+  for (int it = 0; it < opt.iterations; it++) {
+    int files_c = 1 + rand() % MAX_FILES;
+    int list = 0;
+    char file_list[MAX_FILES * 260] = "";
+
+    for (int i = 0; i < files_c; i++) {
+      snprintf(paths[i], sizeof(paths[i]), "%s/chunk_stress_%d_%d.txt", opt.dir, (int)getpid(), i);
+      files[i] = paths[i];
+      if (generateText(paths[i], rand() % 8 == 0 ? 0 : rand() % MAX_FILE_SIZE) != 0)
+        return EXIT_FAILURE;
+      list += snprintf(file_list + list, sizeof(file_list) - list, " %s", paths[i]);
+    }
+
+    // reference: the serial counter, one file at a time
+    int broken = 0;
+    for (int i = 0; i < files_c && !broken; i++) {
+      snprintf(cmd, sizeof(cmd), "timeout %d %s %s", TIMEOUT, opt.serial, paths[i]);
+      broken = runCounter(cmd, &files[i], 1, 0, &ref[i]);
+    }
+    if (broken) {
+      printf("Serial counter failed: %s\n", cmd);
+      return EXIT_FAILURE;
+    }
+
+    int chunk = opt.min_chunk + rand() % (opt.max_chunk - opt.min_chunk + 1);
+    int threads = 1 + rand() % opt.max_threads;
+    snprintf(cmd, sizeof(cmd), "timeout %d %s -c %d %d%s", TIMEOUT, opt.threaded, chunk, threads, file_list);
+    if (runCounter(cmd, files, files_c, -1, got) != 0) {
+      printf("FAILED threaded (crash or timeout)\n  %s\n", cmd);
+      failures++;
+    } else {
+      failures += compare("threaded", files, files_c, ref, got, cmd);
+    }
+
+    if (opt.mpi[0] != '\0') {
+      int procs = 2 + rand() % (opt.max_procs - 1);
+      snprintf(cmd, sizeof(cmd), "timeout %d %s %d %s -c %d%s", TIMEOUT, opt.launcher, procs, opt.mpi, chunk < 2 ? 2 : chunk, file_list);
+      if (runCounter(cmd, files, files_c, -1, got) != 0) {
+        printf("FAILED mpi (crash or timeout)\n  %s\n", cmd);
+        failures++;
+      } else {
+        failures += compare("mpi", files, files_c, ref, got, cmd);
+      }
+    }
+
+    if (failures == 0) {
+      for (int i = 0; i < files_c; i++)
+        unlink(paths[i]);
+    } else {
+      printf("Inputs kept in %s (seed %u, iteration %d)\n", opt.dir, opt.seed, it);
+      break;
+    }
+  }
+
+  printf("%s\n", failures == 0 ? "All counters agree" : "Counters disagree");
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,22 @@
+#define _GNU_SOURCE
+#include "input.h"
+#include <stdio.h>
+
+FILE *openInput(struct input *in) {
+  if (in->data == NULL)
+    return fopen(in->name, "rb");
+  return fmemopen(in->data, in->size, "rb");
+}
+
+long inputSize(struct input *in) {
+  if (in->data != NULL)
+    return in->size;
+
+  FILE *fd = fopen(in->name, "rb");
+  if (fd == NULL)
+    return -1;
+  fseek(fd, 0, SEEK_END);
+  long size = ftell(fd);
+  fclose(fd);
+  return size;
+}
@@ -0,0 +1,30 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+/**
+ * @brief A text to count, either a file or a payload already in memory.
+ */
+struct input {
+  char *name;    // file name, or the name reported for a payload
+  uint8_t *data; // payload, NULL to read the file
+  long size;     // payload size in bytes
+};
+
+/**
+ * @brief Opens an input for reading, payloads are read through a memory stream.
+ *
+ * @return The stream, or NULL if the file can not be opened.
+ */
+extern FILE *openInput(struct input *in);
+
+/**
+ * @brief Gives the size of an input in bytes.
+ *
+ * @return The size, or -1 if the file can not be opened.
+ */
+extern long inputSize(struct input *in);
+
+#endif
@@ -0,0 +1,133 @@
+#include "match.h"
+#include <stdlib.h>
+#include <string.h>
+
+struct matcher *buildMatcher(char **patterns, int patterns_c) {
+  int total = 1;
+  for (int k = 0; k < patterns_c; k++) {
+    if (patterns[k][0] == '\0' || strchr(patterns[k], '\n') != NULL)
+      return NULL;
+    for (int j = 0; j < k; j++) {
+      if (strcmp(patterns[j], patterns[k]) == 0)
+        return NULL;
+    }
+    total += strlen(patterns[k]);
+  }
+
+  struct matcher *m = (struct matcher *)calloc(1, sizeof(struct matcher));
+  m->patterns_c = patterns_c;
+  m->patterns = patterns;
+  m->length = (int *)malloc(patterns_c * sizeof(int));
+  m->next = (int32_t *)calloc((long)total * 256, sizeof(int32_t)); // 0 (the root) is also "no edge yet"
+  m->out = (int32_t *)malloc(total * sizeof(int32_t));
+  m->dict = (int32_t *)calloc(total, sizeof(int32_t));
+  int32_t *fail = (int32_t *)calloc(total, sizeof(int32_t));
+  int32_t *order = (int32_t *)malloc(total * sizeof(int32_t));
+
+  // trie
+  m->states_c = 1;
+  m->out[0] = -1;
+  for (int k = 0; k < patterns_c; k++) {
+    int s = 0;
+    m->length[k] = strlen(patterns[k]);
+    if (m->length[k] > m->max_length)
+      m->max_length = m->length[k];
+    for (int i = 0; i < m->length[k]; i++) {
+      uint8_t c = patterns[k][i];
+      if (m->next[s * 256 + c] == 0) {
+        m->out[m->states_c] = -1;
+        m->next[s * 256 + c] = m->states_c++;
+      }
+      s = m->next[s * 256 + c];
+    }
+    m->out[s] = k;
+  }
+
+  // breadth first: failure links, and the missing edges become the edges of the failure state
+  int head = 0, tail = 0;
+  for (int c = 0; c < 256; c++) {
+    if (m->next[c] != 0)
+      order[tail++] = m->next[c];
+  }
+  while (head < tail) {
+    int s = order[head++];
+    m->dict[s] = m->out[fail[s]] != -1 ? fail[s] : m->dict[fail[s]];
+    for (int c = 0; c < 256; c++) {
+      int t = m->next[s * 256 + c];
+      if (t != 0) {
+        fail[t] = m->next[fail[s] * 256 + c];
+        order[tail++] = t;
+      } else {
+        m->next[s * 256 + c] = m->next[fail[s] * 256 + c];
+      }
+    }
+  }
+
+  free(fail);
+  free(order);
+  return m;
+}
+
+void freeMatcher(struct matcher *m) {
+  if (m == NULL)
+    return;
+  free(m->length);
+  free(m->next);
+  free(m->out);
+  free(m->dict);
+  free(m);
+}
+
+void matchChunk(struct matcher *m, const uint8_t *buf, long chunk_len, long len, long *counts) {
+  int s = 0;
+  int matched = 0; // the current line has a match
+  long *occurrences = counts + MATCH_OCCURRENCES;
+
+  memset(counts, 0, MATCH_FIELDS(m->patterns_c) * sizeof(long));
+  // matches ending later than this start in the next chunk
+  if (len > chunk_len + m->max_length - 1)
+    len = chunk_len + m->max_length - 1;
+
+  for (long i = 0; i < len; i++) {
+    uint8_t c = buf[i];
+    if (c == '\n' && i < chunk_len) {
+      if (!counts[MATCH_NEWLINE])
+        counts[MATCH_HEAD] = matched;
+      else
+        counts[MATCH_LINES] += matched;
+      counts[MATCH_NEWLINE] = 1;
+      matched = 0;
+    }
+
+    s = m->next[s * 256 + c];
+    for (int t = m->out[s] != -1 ? s : m->dict[s]; t != 0; t = m->dict[t]) {
+      int k = m->out[t];
+      if (i - m->length[k] + 1 < chunk_len) { // patterns have no newline, so it is on the current line
+        occurrences[k]++;
+        matched = 1;
+      }
+    }
+  }
+
+  if (!counts[MATCH_NEWLINE])
+    counts[MATCH_HEAD] = matched;
+  counts[MATCH_TAIL] = matched;
+}
+
+void mergeMatches(struct matcher *m, long *file, const long *chunk) {
+  if (!chunk[MATCH_NEWLINE]) { // the open line goes on
+    file[MATCH_TAIL] |= chunk[MATCH_HEAD];
+  } else {
+    file[MATCH_LINES] += (file[MATCH_TAIL] || chunk[MATCH_HEAD]) + chunk[MATCH_LINES];
+    file[MATCH_TAIL] = chunk[MATCH_TAIL];
+    file[MATCH_NEWLINE] = 1;
+  }
+  for (int k = 0; k < m->patterns_c; k++) {
+    file[MATCH_OCCURRENCES + k] += chunk[MATCH_OCCURRENCES + k];
+  }
+}
+
+void finishMatches(long *file) {
+  file[MATCH_LINES] += file[MATCH_TAIL];
+  file[MATCH_TAIL] = 0;
+}
@@ -0,0 +1,69 @@
+#ifndef MATCH_H
+#define MATCH_H
+
+#include <stdint.h>
+
+#define MAX_PATTERNS 256
+
+/*
+ * Layout of the counts of a chunk (and, once merged, of a file): a few line
+ * fields followed by the occurrences of each pattern, kept as a flat long
+ * array so that it can be sent as is with MPI_LONG.
+ */
+enum match_field {
+  MATCH_LINES,       // lines with a match that start and end inside the chunk (file: all of them)
+  MATCH_NEWLINE,     // !0 if the chunk has a newline
+  MATCH_HEAD,        // !0 if a match starts before the first newline (anywhere if there is none)
+  MATCH_TAIL,        // !0 if a match starts after the last newline (file: the line still open)
+  MATCH_OCCURRENCES  // first of the per pattern occurrences
+};
+
+#define MATCH_FIELDS(patterns_c) (MATCH_OCCURRENCES + (patterns_c))
+
+/**
+ * @brief Aho-Corasick automaton over a set of literals, as a full 256 wide transition table.
+ */
+struct matcher {
+  int patterns_c;
+  char **patterns;
+  int *length;
+  int max_length;
+  int states_c;
+  int32_t *next; // states_c * 256 transitions
+  int32_t *out;  // pattern ending at each state, -1 if none
+  int32_t *dict; // closest suffix state that ends a pattern, 0 if none
+};
+
+/**
+ * @brief Builds the automaton of a set of literals (byte strings, no newline).
+ *
+ * @return The matcher, or NULL if a pattern is empty, repeated or has a newline.
+ */
+extern struct matcher *buildMatcher(char **patterns, int patterns_c);
+
+extern void freeMatcher(struct matcher *m);
+
+/**
+ * @brief Counts the matches of a chunk.
+ *
+ * A match is counted by the chunk it starts in, so buf holds the chunk
+ * followed by up to max_length - 1 bytes of the next one.
+ *
+ * @param buf The chunk and the bytes after it.
+ * @param chunk_len The chunk length.
+ * @param len The bytes in buf.
+ * @param counts MATCH_FIELDS(patterns_c) counts, they are overwritten.
+ */
+extern void matchChunk(struct matcher *m, const uint8_t *buf, long chunk_len, long len, long *counts);
+
+/**
+ * @brief Adds the counts of a chunk to the counts of its file, chunks must be merged in file order.
+ */
+extern void mergeMatches(struct matcher *m, long *file, const long *chunk);
+
+/**
+ * @brief Closes the last line of a file after all its chunks were merged.
+ */
+extern void finishMatches(long *file);
+
+#endif
@@ -0,0 +1,230 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+/*
+ * Word metrics computed by the fused scan in nextWord().
+ *
+ * Every metric is listed once in METRIC_LIST and provides static inline hooks:
+ * metric_<name>_char() for each character of a word, metric_<name>_word()
+ * once the word ends, metric_<name>_print() for the text report and
+ * metric_<name>_fields() for the JSON/CSV reports. A metric is
+ * enabled at compile time (e.g. -DMETRIC_VOWEL_START=1); the scan tests the
+ * constant before every hook, so disabled metrics are dropped by the compiler
+ * and the enabled ones are inlined into a single loop over the characters.
+ */
+
+#ifndef METRIC_WORDS
+#define METRIC_WORDS 1
+#endif
+#ifndef METRIC_CONSONANTS
+#define METRIC_CONSONANTS 1
+#endif
+#ifndef METRIC_VOWEL_START
+#define METRIC_VOWEL_START 0
+#endif
+#ifndef METRIC_LENGTH
+#define METRIC_LENGTH 0
+#endif
+#ifndef METRIC_SUFFIX
+#define METRIC_SUFFIX 0
+#endif
+
+#define LENGTH_BUCKETS 16 // words with LENGTH_BUCKETS - 1 or more letters share the last bucket
+#ifndef SUFFIX_STR
+#define SUFFIX_STR "mente" // compared against the accent-folded, lower case letters
+#endif
+#define SUFFIX_LEN (sizeof(SUFFIX_STR) - 1)
+
+#define METRIC_LIST(X)                \
+  X(words, METRIC_WORDS)              \
+  X(consonants, METRIC_CONSONANTS)    \
+  X(vowelStart, METRIC_VOWEL_START)   \
+  X(length, METRIC_LENGTH)            \
+  X(suffix, METRIC_SUFFIX)
+
+enum output_format { OUTPUT_TEXT, OUTPUT_JSON, OUTPUT_CSV };
+
+struct metrics {
+  int words;
+  int consonants;
+  int vowelStart;
+  int suffix;
+  int length[LENGTH_BUCKETS];
+};
+
+// state of the word being scanned, reset at the start of every word
+struct word_st {
+  int chars;     // characters read, delimiter included
+  int letters;   // word letters (merger letters are not counted)
+  uint8_t first; // first word letter
+  uint8_t letter[26];
+  int doubleConsonant;
+  uint8_t tail[SUFFIX_LEN]; // last SUFFIX_LEN letters, used as a ring buffer
+};
+
+static inline int isVowel(uint8_t c) {
+  return c == 'a' || c == 'e' || c == 'i' || c == 'o' || c == 'u';
+}
+
+/*
+ * one field of a JSON/CSV report: "key": value for JSON, ,value for CSV
+ * and ,key for the CSV header (m == NULL)
+ */
+static inline void metricField(FILE *out, enum output_format format, const struct metrics *m, const char *key, int value) {
+  if (format == OUTPUT_JSON)
+    fprintf(out, ", \"%s\": %d", key, value);
+  else if (m == NULL)
+    fprintf(out, ",%s", key);
+  else
+    fprintf(out, ",%d", value);
+}
+
+/* words: a word needs at least one word letter and a delimiter after it */
+static inline void metric_words_char(struct word_st *w, uint8_t c) {}
+static inline void metric_words_word(struct word_st *w, struct metrics *m) {
+  m->words += w->chars > 1 && w->letters > 0;
+}
+static inline void metric_words_print(FILE *out, const struct metrics *m) {
+  fprintf(out, "Number of words: %d\n", m->words);
+}
+static inline void metric_words_fields(FILE *out, enum output_format format, const struct metrics *m) {
+  metricField(out, format, m, "words", m ? m->words : 0);
+}
+
+/* consonants: words with at least two instances of the same consonant */
+static inline void metric_consonants_char(struct word_st *w, uint8_t c) {
+  if (c >= 'a' && c <= 'z' && !isVowel(c)) {
+    if ((++w->letter[c - 'a']) >= 2) {
+      w->doubleConsonant = 1;
+    }
+  }
+}
+static inline void metric_consonants_word(struct word_st *w, struct metrics *m) {
+  m->consonants += w->doubleConsonant;
+}
+static inline void metric_consonants_print(FILE *out, const struct metrics *m) {
+  fprintf(out, "Number of words with at least two instances of the same consonant: %d\n", m->consonants);
+}
+static inline void metric_consonants_fields(FILE *out, enum output_format format, const struct metrics *m) {
+  metricField(out, format, m, "consonants", m ? m->consonants : 0);
+}
+
+/* vowelStart: words whose first letter is a vowel */
+static inline void metric_vowelStart_char(struct word_st *w, uint8_t c) {}
+static inline void metric_vowelStart_word(struct word_st *w, struct metrics *m) {
+  m->vowelStart += w->letters > 0 && isVowel(w->first);
+}
+static inline void metric_vowelStart_print(FILE *out, const struct metrics *m) {
+  fprintf(out, "Number of words starting with a vowel: %d\n", m->vowelStart);
+}
+static inline void metric_vowelStart_fields(FILE *out, enum output_format format, const struct metrics *m) {
+  metricField(out, format, m, "vowel_start", m ? m->vowelStart : 0);
+}
+
+/* length: histogram of the number of letters per word */
+static inline void metric_length_char(struct word_st *w, uint8_t c) {}
+static inline void metric_length_word(struct word_st *w, struct metrics *m) {
+  if (w->letters > 0) {
+    m->length[w->letters < LENGTH_BUCKETS ? w->letters : LENGTH_BUCKETS - 1]++;
+  }
+}
+static inline void metric_length_print(FILE *out, const struct metrics *m) {
+  fprintf(out, "Word length histogram:");
+  for (int i = 1; i < LENGTH_BUCKETS; i++) {
+    fprintf(out, " %d%s:%d", i, i == LENGTH_BUCKETS - 1 ? "+" : "", m->length[i]);
+  }
+  fprintf(out, "\n");
+}
+static inline void metric_length_fields(FILE *out, enum output_format format, const struct metrics *m) {
+  char key[32];
+  for (int i = 1; i < LENGTH_BUCKETS; i++) {
+    snprintf(key, sizeof(key), "length_%d%s", i, i == LENGTH_BUCKETS - 1 ? "_plus" : "");
+    metricField(out, format, m, key, m ? m->length[i] : 0);
+  }
+}
+
+/* suffix: words whose last letters are SUFFIX_STR */
+static inline void metric_suffix_char(struct word_st *w, uint8_t c) {
+  w->tail[(w->letters - 1) % SUFFIX_LEN] = c;
+}
+static inline void metric_suffix_word(struct word_st *w, struct metrics *m) {
+  if (w->letters < (int)SUFFIX_LEN) {
+    return;
+  }
+  int found = 1;
+  for (int i = 0; i < (int)SUFFIX_LEN; i++) {
+    found &= w->tail[(w->letters + i) % SUFFIX_LEN] == (uint8_t)SUFFIX_STR[i];
+  }
+  m->suffix += found;
+}
+static inline void metric_suffix_print(FILE *out, const struct metrics *m) {
+  fprintf(out, "Number of words ending in \"%s\": %d\n", SUFFIX_STR, m->suffix);
+}
+static inline void metric_suffix_fields(FILE *out, enum output_format format, const struct metrics *m) {
+  metricField(out, format, m, "suffix", m ? m->suffix : 0);
+}
+
+/*
+ * Hooks called by the scan. letter is the folded character, isLetter tells if
+ * it is a word letter (as opposed to a merger letter).
+ */
+static inline void wordStart(struct word_st *w) {
+  memset(w, 0, sizeof(struct word_st));
+}
+
+static inline void wordChar(struct word_st *w, uint8_t c, int isLetter) {
+  w->chars++;
+  if (!isLetter) {
+    return;
+  }
+  if (w->letters++ == 0) {
+    w->first = c;
+  }
+#define X(name, enabled) \
+  if (enabled)           \
+    metric_##name##_char(w, c);
+  METRIC_LIST(X)
+#undef X
+}
+
+static inline void wordEnd(struct word_st *w, struct metrics *m) {
+  w->chars++; // delimiter
+#define X(name, enabled) \
+  if (enabled)           \
+    metric_##name##_word(w, m);
+  METRIC_LIST(X)
+#undef X
+}
+
+static inline void metricsAdd(struct metrics *dst, const struct metrics *src, int sign) {
+  dst->words += sign * src->words;
+  dst->consonants += sign * src->consonants;
+  dst->vowelStart += sign * src->vowelStart;
+  dst->suffix += sign * src->suffix;
+  for (int i = 0; i < LENGTH_BUCKETS; i++) {
+    dst->length[i] += sign * src->length[i];
+  }
+}
+
+static inline void metricsPrint(FILE *out, const struct metrics *m) {
+#define X(name, enabled) \
+  if (enabled)           \
+    metric_##name##_print(out, m);
+  METRIC_LIST(X)
+#undef X
+}
+
+// JSON/CSV fields of the enabled metrics, m == NULL gives the CSV header
+static inline void metricsFields(FILE *out, enum output_format format, const struct metrics *m) {
+#define X(name, enabled) \
+  if (enabled)           \
+    metric_##name##_fields(out, format, m);
+  METRIC_LIST(X)
+#undef X
+}
+
+#endif // !METRICS_H
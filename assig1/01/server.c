@@ -0,0 +1,303 @@
+#define _GNU_SOURCE
+#include "server.h"
+#include <errno.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_LINE 4096
+#define CLIENT_TIMEOUT_S 5 // a client silent (or not reading) for longer is dropped
+
+static volatile sig_atomic_t stop = 0;
+
+// the connections are read concurrently, the counts run one at a time on the resident pool
+static pthread_mutex_t handle_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t conn_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t conn_cond = PTHREAD_COND_INITIALIZER;
+static int conn_c = 0; // connections still being served
+static long payload_c = 0; // bytes of the payloads held by all the connections, see MAX_SERVER_PAYLOAD
+
+struct connection {
+  int fd;
+  request_handler handle;
+};
+
+static void onSignal(int sig) {
+  stop = 1;
+}
+
+static void freeInputs(struct input *inputs, int inputs_c) {
+  for (int i = 0; i < inputs_c; i++) {
+    free(inputs[i].name);
+    free(inputs[i].data);
+  }
+}
+
+/*
+ * reads the request lines of a connection into inputs
+ * returns the number of inputs, or -1 after writing the error to out
+ * */
+static int readRequest(FILE *in, FILE *out, struct input *inputs, enum output_format *format) {
+  char line[MAX_LINE];
+  int inputs_c = 0;
+  int failed = 0;
+  long payload = 0; // bytes of the payloads read so far
+
+  while (fgets(line, sizeof(line), in) != NULL) {
+    line[strcspn(line, "\r\n")] = '\0';
+
+    if (line[0] == '\0') { // blank lines, e.g. the newline after a payload
+      continue;
+
+    } else if (strcmp(line, "END") == 0) {
+      break;
+
+    } else if (strncmp(line, "FORMAT ", 7) == 0) {
+      if (strcmp(line + 7, "text") == 0) {
+        *format = OUTPUT_TEXT;
+      } else if (strcmp(line + 7, "json") == 0) {
+        *format = OUTPUT_JSON;
+      } else if (strcmp(line + 7, "csv") == 0) {
+        *format = OUTPUT_CSV;
+      } else {
+        fprintf(out, "ERROR invalid format: %s\n", line + 7);
+        failed = 1;
+        break;
+      }
+
+    } else if (inputs_c == MAX_REQUEST_INPUTS) {
+      fprintf(out, "ERROR too many inputs, at most %d per request\n", MAX_REQUEST_INPUTS);
+      failed = 1;
+      break;
+
+    } else if (strncmp(line, "FILE ", 5) == 0) {
+      inputs[inputs_c].name = strdup(line + 5);
+      inputs[inputs_c].data = NULL;
+      inputs[inputs_c].size = 0;
+      inputs_c++;
+      if (inputs[inputs_c - 1].name == NULL) {
+        fprintf(out, "ERROR out of memory\n");
+        failed = 1;
+        break;
+      }
+
+    } else if (strncmp(line, "DATA ", 5) == 0) {
+      char *name;
+      long size = strtol(line + 5, &name, 10);
+      if (name == line + 5 || size < 0 || size > MAX_PAYLOAD_SIZE) {
+        fprintf(out, "ERROR invalid payload length: %s\n", line + 5);
+        failed = 1;
+        break;
+      }
+      if (size > MAX_REQUEST_PAYLOAD - payload) {
+        fprintf(out, "ERROR payloads too long, at most %ld bytes per request\n", MAX_REQUEST_PAYLOAD);
+        failed = 1;
+        break;
+      }
+      if (__atomic_add_fetch(&payload_c, size, __ATOMIC_RELAXED) > MAX_SERVER_PAYLOAD) {
+        __atomic_sub_fetch(&payload_c, size, __ATOMIC_RELAXED);
+        fprintf(out, "ERROR server busy, try again later\n");
+        failed = 1;
+        break;
+      }
+      payload += size;
+      name += strspn(name, " ");
+      if (*name == '\0') {
+        snprintf(line, sizeof(line), "data%d", inputs_c);
+        name = line;
+      }
+      inputs[inputs_c].name = strdup(name);
+      inputs[inputs_c].data = (uint8_t *)malloc(size + 1);
+      inputs[inputs_c].size = size;
+      inputs_c++;
+      if (inputs[inputs_c - 1].name == NULL || inputs[inputs_c - 1].data == NULL) {
+        fprintf(out, "ERROR out of memory for a payload of %ld bytes\n", size);
+        failed = 1;
+        break;
+      }
+      if (fread(inputs[inputs_c - 1].data, 1, size, in) != (size_t)size) {
+        fprintf(out, "ERROR payload shorter than %ld bytes\n", size);
+        failed = 1;
+        break;
+      }
+
+    } else {
+      fprintf(out, "ERROR unknown request: %s\n", line);
+      failed = 1;
+      break;
+    }
+  }
+  if (!failed && ferror(in)) { // the receive timeout, the request may be incomplete
+    fprintf(out, "ERROR request timed out\n");
+    failed = 1;
+  }
+
+  if (failed) {
+    __atomic_sub_fetch(&payload_c, payload, __ATOMIC_RELAXED);
+    freeInputs(inputs, inputs_c);
+    return -1;
+  }
+  return inputs_c;
+}
+
+// the payloads of a request were freed
+static void releasePayload(const struct input *inputs, int inputs_c) {
+  long payload = 0;
+  for (int i = 0; i < inputs_c; i++) {
+    if (inputs[i].data != NULL)
+      payload += inputs[i].size;
+  }
+  __atomic_sub_fetch(&payload_c, payload, __ATOMIC_RELAXED);
+}
+
+static void endConnection(struct connection *c) {
+  free(c);
+  pthread_mutex_lock(&conn_mutex);
+  conn_c--;
+  pthread_cond_signal(&conn_cond);
+  pthread_mutex_unlock(&conn_mutex);
+}
+
+/*
+ * connection thread: reads one request and counts it once the pool is free
+ * */
+static void *serveConnection(void *args) {
+  struct connection *c = (struct connection *)args;
+  struct input *inputs = (struct input *)malloc(MAX_REQUEST_INPUTS * sizeof(struct input));
+  FILE *in = fdopen(c->fd, "rb");
+  FILE *out = in != NULL ? fdopen(dup(c->fd), "wb") : NULL;
+
+  if (inputs == NULL || in == NULL || out == NULL) {
+    perror("connection");
+    if (in != NULL)
+      fclose(in);
+    else
+      close(c->fd);
+    if (out != NULL)
+      fclose(out);
+    free(inputs);
+    endConnection(c);
+    return NULL;
+  }
+
+  enum output_format format = OUTPUT_TEXT;
+  int inputs_c = readRequest(in, out, inputs, &format);
+  if (inputs_c >= 0) {
+    pthread_mutex_lock(&handle_mutex);
+    c->handle(inputs, inputs_c, format, out);
+    pthread_mutex_unlock(&handle_mutex);
+    releasePayload(inputs, inputs_c);
+    freeInputs(inputs, inputs_c);
+  }
+
+  fclose(out);
+  fclose(in);
+  free(inputs);
+  endConnection(c);
+  return NULL;
+}
+
+int serve(const char *path, request_handler handle) {
+  struct sockaddr_un addr;
+  struct sigaction sa;
+
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    fprintf(stderr, "Socket path too long: %s\n", path);
+    return 1;
+  }
+
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (sock == -1) {
+    perror("socket");
+    return 1;
+  }
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path, path);
+  unlink(path);
+  if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) == -1 || listen(sock, 64) == -1) {
+    perror(path);
+    close(sock);
+    return 1;
+  }
+
+  // no SA_RESTART, accept must return on a signal so the server can stop
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onSignal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+  signal(SIGPIPE, SIG_IGN); // a client leaving early must not kill the server
+
+  // the connection threads block the signals, they interrupt the accept of this one
+  sigset_t signals, old_signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  pthread_attr_t attr;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+
+  while (!stop) {
+    // a connection is accepted when there is room for it, the wait wakes up to see a signal
+    pthread_mutex_lock(&conn_mutex);
+    while (conn_c >= MAX_CONNECTIONS && !stop) {
+      struct timespec wake;
+      clock_gettime(CLOCK_REALTIME, &wake);
+      wake.tv_sec++;
+      pthread_cond_timedwait(&conn_cond, &conn_mutex, &wake);
+    }
+    pthread_mutex_unlock(&conn_mutex);
+    if (stop)
+      break;
+
+    int conn = accept(sock, NULL, NULL);
+    if (conn == -1) {
+      if (errno != EINTR)
+        perror("accept");
+      continue;
+    }
+
+    struct timeval timeout = {CLIENT_TIMEOUT_S, 0};
+    setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(conn, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    struct connection *c = (struct connection *)malloc(sizeof(struct connection));
+    pthread_t thread;
+    if (c == NULL) {
+      fprintf(stderr, "Out of memory for a connection\n");
+      close(conn);
+      continue;
+    }
+    c->fd = conn;
+    c->handle = handle;
+
+    pthread_mutex_lock(&conn_mutex);
+    conn_c++;
+    pthread_mutex_unlock(&conn_mutex);
+    pthread_sigmask(SIG_BLOCK, &signals, &old_signals);
+    int err = pthread_create(&thread, &attr, serveConnection, c);
+    pthread_sigmask(SIG_SETMASK, &old_signals, NULL);
+    if (err != 0) {
+      fprintf(stderr, "pthread_create: %s\n", strerror(err));
+      close(conn);
+      endConnection(c);
+    }
+  }
+  pthread_attr_destroy(&attr);
+
+  // the handler must outlive the connections
+  pthread_mutex_lock(&conn_mutex);
+  while (conn_c > 0)
+    pthread_cond_wait(&conn_cond, &conn_mutex);
+  pthread_mutex_unlock(&conn_mutex);
+
+  close(sock);
+  unlink(path);
+  return 0;
+}
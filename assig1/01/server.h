@@ -0,0 +1,40 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdio.h>
+
+#include "input.h"
+#include "metrics.h"
+
+#define MAX_REQUEST_INPUTS 1024
+#define MAX_PAYLOAD_SIZE (1L << 30)
+#define MAX_REQUEST_PAYLOAD (1L << 30) // bytes of all the payloads of a request
+#define MAX_SERVER_PAYLOAD (4L << 30)  // bytes of the payloads of all the requests being served
+#define MAX_CONNECTIONS 32             // served at once, the others wait in the listen backlog
+
+/**
+ * @brief Counts the inputs of one request and writes the report to out.
+ *
+ * @return 0 on success, !0 if the request failed (the error was written to out).
+ */
+typedef int (*request_handler)(struct input *inputs, int inputs_c, enum output_format format, FILE *out);
+
+/**
+ * @brief Serves count requests on a Unix domain socket until SIGINT or SIGTERM.
+ *
+ * One request per connection, made of lines:
+ *   FORMAT text|json|csv     (optional, text by default)
+ *   FILE <path>              count a file the server can read
+ *   DATA <length> [<name>]   count the <length> bytes that follow the line
+ *   END                      (or closing the write side of the connection)
+ * The reply is the report of the counter, or a line starting with ERROR.
+ * Each connection is read by its own thread, at most MAX_CONNECTIONS at once, and dropped if the
+ * client stalls for a few seconds; the requests are counted one at a time.
+ *
+ * @param path The socket path, it is removed when the server stops.
+ * @param handle Counts the inputs of each request.
+ * @return 0 if the server stopped on a signal, !0 if it could not start.
+ */
+extern int serve(const char *path, request_handler handle);
+
+#endif
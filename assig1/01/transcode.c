@@ -0,0 +1,164 @@
+#include "transcode.h"
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+int parseEncoding(const char *arg, enum encoding *encoding) {
+  if (strcmp(arg, "auto") == 0)
+    *encoding = ENCODING_AUTO;
+  else if (strcmp(arg, "utf8") == 0)
+    *encoding = ENCODING_UTF8;
+  else if (strcmp(arg, "utf16le") == 0)
+    *encoding = ENCODING_UTF16LE;
+  else if (strcmp(arg, "latin1") == 0)
+    *encoding = ENCODING_LATIN1;
+  else
+    return -1;
+  return 0;
+}
+
+enum encoding detectEncoding(const uint8_t *buf, long len, enum encoding encoding, int *bom_s) {
+  *bom_s = 0;
+  if (len >= 3 && buf[0] == 0xEF && buf[1] == 0xBB && buf[2] == 0xBF) {
+    if (encoding == ENCODING_AUTO || encoding == ENCODING_UTF8) {
+      *bom_s = 3;
+      return ENCODING_UTF8;
+    }
+  } else if (len >= 2 && buf[0] == 0xFF && buf[1] == 0xFE) {
+    if (encoding == ENCODING_AUTO || encoding == ENCODING_UTF16LE) {
+      *bom_s = 2;
+      return ENCODING_UTF16LE;
+    }
+  }
+  return encoding == ENCODING_AUTO ? ENCODING_UTF8 : encoding;
+}
+
+long transcodedSize(enum encoding encoding, long len) {
+  switch (encoding) {
+  case ENCODING_LATIN1:
+    return 2 * len; // U+0080..U+00FF take 2 bytes
+  case ENCODING_UTF16LE:
+    return 3 * (len / 2) + REPLACEMENT_SIZE; // a unit takes at most 3 bytes, a pair 4, plus an odd byte
+  default:
+    return len;
+  }
+}
+
+static inline long putUTF8(uint8_t *out, uint32_t code) {
+  if (code < 0x80) {
+    out[0] = (uint8_t)code;
+    return 1;
+  }
+  if (code < 0x800) {
+    out[0] = 0xC0 | (code >> 6);
+    out[1] = 0x80 | (code & 0x3F);
+    return 2;
+  }
+  if (code < 0x10000) {
+    out[0] = 0xE0 | (code >> 12);
+    out[1] = 0x80 | ((code >> 6) & 0x3F);
+    out[2] = 0x80 | (code & 0x3F);
+    return 3;
+  }
+  out[0] = 0xF0 | (code >> 18);
+  out[1] = 0x80 | ((code >> 12) & 0x3F);
+  out[2] = 0x80 | ((code >> 6) & 0x3F);
+  out[3] = 0x80 | (code & 0x3F);
+  return 4;
+}
+
+/*
+ * Latin-1 code points are the byte values, ASCII runs are copied 16 bytes at a time
+ * */
+static long latin1ToUTF8(const uint8_t *buf, long len, uint8_t *out) {
+  long i = 0, o = 0;
+
+  while (i < len) {
+#ifdef __SSE2__
+    for (; i + 16 <= len; i += 16, o += 16) {
+      __m128i in = _mm_loadu_si128((const __m128i *)(buf + i));
+      if (_mm_movemask_epi8(in) != 0)
+        break;
+      _mm_storeu_si128((__m128i *)(out + o), in);
+    }
+#endif
+    long end = i + 16 < len ? i + 16 : len;
+    for (; i < end; i++) {
+      o += putUTF8(out + o, buf[i]);
+    }
+  }
+  return o;
+}
+
+/*
+ * ASCII runs (8 units below 0x80) are narrowed 8 units at a time, the rest
+ * goes through the scalar decoder
+ * a block that is not the last leaves its odd trailing byte, and a high surrogate
+ * cut from its low one, to the next block
+ * */
+static long utf16leToUTF8(const uint8_t *buf, long len, int last, long offset, enum utf8_policy policy, uint8_t *out,
+                          long *out_len, struct utf8_errors *errors) {
+  long units = len / 2;
+  long i = 0, o = 0;
+
+  while (i < units) {
+#ifdef __SSE2__
+    const __m128i high = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= units; i += 8, o += 8) {
+      __m128i in = _mm_loadu_si128((const __m128i *)(buf + 2 * i));
+      if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(in, high), zero)) != 0xFFFF)
+        break;
+      _mm_storel_epi64((__m128i *)(out + o), _mm_packus_epi16(in, in));
+    }
+#endif
+    long end = i + 8 < units ? i + 8 : units;
+    while (i < end) {
+      uint32_t unit = buf[2 * i] | (uint32_t)buf[2 * i + 1] << 8;
+      if (unit < 0xD800 || unit > 0xDFFF) {
+        o += putUTF8(out + o, unit);
+        i++;
+        continue;
+      }
+      if (unit <= 0xDBFF && i + 1 == units && !last) { // its low surrogate is in the next block
+        *out_len = o;
+        return 2 * i;
+      }
+      uint32_t low = i + 1 < units ? buf[2 * i + 2] | (uint32_t)buf[2 * i + 3] << 8 : 0;
+      if (unit <= 0xDBFF && low >= 0xDC00 && low <= 0xDFFF) { // surrogate pair
+        o += putUTF8(out + o, 0x10000 + ((unit - 0xD800) << 10) + (low - 0xDC00));
+        i += 2;
+        continue;
+      }
+      addError(errors, offset + 2 * i, 2); // unpaired surrogate
+      if (policy == UTF8_REPLACE)
+        o += putUTF8(out + o, 0xFFFD);
+      i++;
+    }
+  }
+
+  if (len % 2 && last) {
+    addError(errors, offset + len - 1, 1);
+    if (policy == UTF8_REPLACE)
+      o += putUTF8(out + o, 0xFFFD);
+  }
+  *out_len = o;
+  return last ? len : 2 * units;
+}
+
+long transcodeUTF8(const uint8_t *buf, long len, int last, long offset, enum encoding encoding, enum utf8_policy policy,
+                   uint8_t *out, long *out_len, struct utf8_errors *errors) {
+  switch (encoding) {
+  case ENCODING_LATIN1:
+    *out_len = latin1ToUTF8(buf, len, out);
+    return len;
+  case ENCODING_UTF16LE:
+    return utf16leToUTF8(buf, len, last, offset, policy, out, out_len, errors);
+  default:
+    memcpy(out, buf, len);
+    *out_len = len;
+    return len;
+  }
+}
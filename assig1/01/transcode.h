@@ -0,0 +1,60 @@
+#ifndef TRANSCODE_H
+#define TRANSCODE_H
+
+#include <stdint.h>
+
+#include "validate.h"
+
+#define MAX_BOM_SIZE 3
+
+/**
+ * @brief Encoding of an input, the counters only read UTF-8.
+ */
+enum encoding {
+  ENCODING_AUTO,    // from the byte order mark, UTF-8 if there is none
+  ENCODING_UTF8,
+  ENCODING_UTF16LE,
+  ENCODING_LATIN1   // ISO-8859-1
+};
+
+/**
+ * @brief Parses an encoding name ("auto", "utf8", "utf16le" or "latin1").
+ *
+ * @return 0 on success, -1 if the name is unknown.
+ */
+extern int parseEncoding(const char *arg, enum encoding *encoding);
+
+/**
+ * @brief Resolves the encoding of an input from its first bytes.
+ *
+ * @param buf The first bytes of the input.
+ * @param len How many (at most MAX_BOM_SIZE are looked at).
+ * @param encoding The requested encoding, ENCODING_AUTO to look for a byte order mark.
+ * @param bom_s The size of the byte order mark found, it is not counted.
+ * @return The encoding of the input, never ENCODING_AUTO.
+ */
+extern enum encoding detectEncoding(const uint8_t *buf, long len, enum encoding encoding, int *bom_s);
+
+/**
+ * @brief The output size transcodeUTF8() may need for len input bytes.
+ */
+extern long transcodedSize(enum encoding encoding, long len);
+
+/**
+ * @brief Converts a block of a UTF-16LE or Latin-1 input to UTF-8.
+ *
+ * Latin-1 can not be invalid. Unpaired UTF-16 surrogates and an odd trailing
+ * byte are bad sequences: they are added to errors (with their input offset)
+ * and replaced by U+FFFD or dropped as the policy says.
+ *
+ * @param last !0 if the block ends the input.
+ * @param offset Of the block in the input, for the errors.
+ * @param out At least transcodedSize(encoding, len) bytes.
+ * @param out_len The length of the UTF-8 output.
+ * @return The bytes converted, as utf8Validate a code unit or a surrogate pair cut by the
+ * end of a block that is not the last is left and should start the next block.
+ */
+extern long transcodeUTF8(const uint8_t *buf, long len, int last, long offset, enum encoding encoding,
+                          enum utf8_policy policy, uint8_t *out, long *out_len, struct utf8_errors *errors);
+
+#endif
@@ -23,11 +23,10 @@ void printlnUTF8(union UTF8 *utf8) {
 int nextUTF8(FILE *fd, union UTF8 *utf) {
   utf->code = 0;
 
-  // read first byte
-  fread(&utf->bytes[3], 1, 1, fd);
-  uint8_t c = utf->bytes[3];
-  if (c == 0)
+  // read first byte, a 0x00 byte is a character like any other
+  if (fread(&utf->bytes[3], 1, 1, fd) != 1)
     return 0;
+  uint8_t c = utf->bytes[3];
 
   uint8_t n = 1;
 
@@ -133,11 +132,13 @@ int nextWord(FILE *fd, int *words, int *consonants) {
 
   do {
     int n = nextUTF8(fd, &utf);
-    if (n == 0) { // EOF
+    if (n == 0) { // EOF, it also ends the last word
+      (*words) += foundWordLetter;
+      (*consonants) += foundDoubleConsonant;
       return -1;
     }
     removeAccentuation(&utf);
-    printUTF8(&utf);
+    // printUTF8(&utf);
 
     uint8_t c = utf.bytes[3];
     if (c >= 'a' && c <= 'z' && c != 'a' && c != 'e' && c != 'i' && c != 'o' && c != 'u') {
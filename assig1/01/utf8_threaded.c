@@ -1,9 +1,41 @@
+/* USAGE:
+gcc -Wall -O3 -o utf8_threaded utf8_threaded.c affinity.c input.c server.c validate.c transcode.c match.c wordsort.c -lpthread
+./utf8_threaded 4 text0.txt text1.txt
+./utf8_threaded -a scatter 16 text0.txt text1.txt
+./utf8_threaded -o json 4 text0.txt text1.txt
+./utf8_threaded -u reject 4 text0.txt text1.txt
+./utf8_threaded -e latin1 4 latin1.txt
+./utf8_threaded -f 4 /var/log/app.log
+./utf8_threaded -w vocabulary.txt -d 4 text0.txt text1.txt
+./utf8_threaded -p error -p warning -p "não" 4 text0.txt text1.txt
+./utf8_threaded -s /tmp/utf8_threaded.sock 4 &
+printf 'FILE text0.txt\nDATA 11 inline\nhello world\nEND\n' | nc -U /tmp/utf8_threaded.sock
+extra metrics are chosen at compile time, e.g. -DMETRIC_VOWEL_START=1 -DMETRIC_LENGTH=1 -DMETRIC_SUFFIX=1 -DSUFFIX_STR='"mente"'
+*/
+#define _GNU_SOURCE
 #include <pthread.h>
+#include <poll.h>
+#include <signal.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
-#define BUFFER_SIZE 1024 * 4
+#include "affinity.h"
+#include "input.h"
+#include "match.h"
+#include "metrics.h"
+#include "server.h"
+#include "transcode.h"
+#include "validate.h"
+#include "wordsort.h"
+
+#define BUFFER_SIZE (1024 * 4)
+#define IO_BUFFER_SIZE (1024 * 64) // stdio buffer of each worker, reused by every file it opens
 #define False 0
 #define True !False
 
@@ -12,22 +44,46 @@ union UTF8 {
   uint32_t code;
 };
 
+/*
+ * counts of one file found by one worker, padded to a cache line so that
+ * workers never write to the same line
+ * */
+struct file_result {
+  struct metrics m;
+} __attribute__((aligned(64)));
+
+/*
+ * state shared by the persistent worker pool, a job is handed to the workers
+ * by bumping generation and is done when running drops back to 0
+ * */
+struct worker_st;
+
 struct worker_shm {
   char *file_str;
-  int *words;
-  int *consonants;
+  void (*job)(struct worker_st *st, char *iobuf); // run by every worker
+  struct file_result *results; // thread_c rows of files_c results, a row per worker
   int thread_c;
   pthread_mutex_t mutex;
+  pthread_cond_t start;
+  pthread_cond_t done;
+  int generation; // number of jobs handed to the workers so far
+  int running;    // workers still busy with the current job
+  int shutdown;
 };
 
 struct worker_st {
   int id;
+  int node; // NUMA node the worker is pinned to (0 if not pinned)
   struct worker_shm *shm;
 };
 
 // GLOBAL VARIABLES
-char **files;
+struct input *files; // inputs of the current job
 int files_c;
+long chunk_s = BUFFER_SIZE; // bytes per sub sequence
+enum utf8_policy policy = UTF8_REPLACE;
+enum encoding encoding = ENCODING_AUTO;
+struct matcher *matcher = NULL; // pattern mode, the literals are counted instead of the words
 
 static double get_delta_time(void) {
   static struct timespec t0, t1;
@@ -51,11 +107,10 @@ void printlnUTF8(union UTF8 *utf8) {
 int nextUTF8(FILE *fd, union UTF8 *utf) {
   utf->code = 0;
 
-  // read first byte
-  fread(&utf->bytes[3], 1, 1, fd);
-  uint8_t c = utf->bytes[3];
-  if (c == 0)
+  // read first byte, a 0x00 byte is a character like any other
+  if (fread(&utf->bytes[3], 1, 1, fd) != 1)
     return -1;
+  uint8_t c = utf->bytes[3];
 
   uint8_t n = 1;
 
@@ -151,186 +206,1402 @@ int isMergerLetter(union UTF8 *utf) {
 }
 
 // might read a word or not, can not be used to always get a word, only use case is this problem use case
-int nextWord(FILE *fd, int *words, int *consonants) {
-  int letter[26] = {0};
+// the metrics of the word read are stored in found (all zero if no word was read)
+int nextWord(FILE *fd, struct metrics *found) {
+  struct word_st word;
   union UTF8 utf;
-  int foundWordLetter = 0;
-  int foundDoubleConsonant = 0;
-  int i = 0;
   int n;
 
-  do {
-    n = nextUTF8(fd, &utf);
-    if (n == 0) { // EOF
-      return -1;
-    }
+  memset(found, 0, sizeof(struct metrics));
+  wordStart(&word);
+  while (True) {
+    n = nextUTF8(fd, &utf); // EOF (-1) reads as a delimiter and ends the last word
     removeAccentuation(&utf);
     // printUTF8(&utf);
 
-    uint8_t c = utf.bytes[3];
-    if (c >= 'a' && c <= 'z' && c != 'a' && c != 'e' && c != 'i' && c != 'o' && c != 'u') {
-      if ((++letter[c - 'a']) >= 2) {
-        foundDoubleConsonant = 1;
-      }
-    }
-    i++;
-    foundWordLetter = isWordLetter(&utf) || foundWordLetter;
-
-  } while (isWordLetter(&utf) || isMergerLetter(&utf));
-  (*words) = i > 1 && foundWordLetter;
-  (*consonants) = foundDoubleConsonant;
+    int letter = isWordLetter(&utf);
+    if (!letter && !isMergerLetter(&utf))
+      break;
+    wordChar(&word, utf.bytes[3], letter);
+  }
+  wordEnd(&word, found);
   return n; // number of bytes read
 }
 
 /*
- * gives the file descriptor for the next available block
- * is protected by a mutex that provides mutual exclusion
- * uses static variables to keep track of current file and position
- * returns !0 if no next block available (the thread should when, no more work to do)
+ * sub sequence of a file handled by one worker, it starts at start and
+ * ends at the first word that ends after start + chunk_s
+ * */
+struct chunk {
+  int file;
+  long start;
+};
+
+/*
+ * chunks of one NUMA node, the chunks are striped over the nodes once and
+ * each worker drains the queue of its own node before helping the others,
+ * so with pinned workers the same node always reads (first-touches) the same
+ * part of the files and its page cache
  * */
-static int distributor(FILE **fd, int *file_index) {
-  static pthread_mutex_t mut = PTHREAD_MUTEX_INITIALIZER;
-  static int file_i = 0;   // between 0 and file count
-  static int file_pos = 0; // multiple of BLOCK_SIZE
-  static long file_s = 0;  // keeps the file size for easier access
+struct queue {
+  int next; // next chunk to hand out, advanced atomically
+  int end;
+} __attribute__((aligned(64)));
 
-  pthread_mutex_lock(&mut);
+// GLOBAL VARIABLES
+struct chunk *chunks;
+int chunks_c;
+struct queue queues[MAX_NODES];
+int queues_c = 1;
 
-  if (file_i >= files_c) {
-    pthread_mutex_unlock(&mut);
-    return 1; // all files read
+/*
+ * stripes the chunk table over the queues, so that another job can go over the same chunks
+ * */
+static void rewindQueues(void) {
+  for (int q = 0; q < queues_c; q++) {
+    queues[q].next = (int)((long)chunks_c * q / queues_c);
+    queues[q].end = (int)((long)chunks_c * (q + 1) / queues_c);
   }
+}
 
-  *file_index = file_i;
-
-  // open file descriptor for current thread
-  *fd = fopen(files[file_i], "rb");
-  fseek(*fd, 0, SEEK_END);
-  file_s = ftell(*fd);
-  fseek(*fd, file_pos, SEEK_SET);
+/*
+ * splits all the files in chunks of chunk_s bytes and stripes them over the queues
+ * the chunk table is kept between jobs and only grows
+ * returns !0 if a file can not be opened (the error is written to err)
+ * */
+static int buildChunks(int nodes_c, FILE *err) {
+  static int chunks_max = 0;
 
-  // printf("distributtor %d\n", file_pos);
+  chunks_c = 0;
+  for (int i = 0; i < files_c; i++) {
+    long file_s = inputSize(&files[i]);
+    if (file_s < 0) {
+      fprintf(err, "ERROR opening file: %s\n", files[i].name);
+      return 1;
+    }
 
-  // prepare the variables for the next thread
-  if (file_pos + BUFFER_SIZE > file_s) { // reached end of file
-    if (file_i + 1 > files_c) {
-      pthread_mutex_unlock(&mut);
-      return 1; // all files read
+    long count = file_s / chunk_s + 1; // an empty file still gets a chunk so it is reported
+    if (chunks_c + count > chunks_max) {
+      chunks_max = chunks_c + count;
+      chunks = (struct chunk *)realloc(chunks, chunks_max * sizeof(struct chunk));
+    }
+    for (long c = 0; c < count; c++) {
+      chunks[chunks_c].file = i;
+      chunks[chunks_c].start = c * chunk_s;
+      chunks_c++;
     }
-    file_i++;
-    file_pos = 0;
-  } else {
-    file_pos += BUFFER_SIZE;
   }
 
-  pthread_mutex_unlock(&mut);
+  queues_c = nodes_c;
+  rewindQueues();
   return 0;
 }
 
-void *worker(void *args) {
-  struct worker_st *st = (struct worker_st *)args;
+/*
+ * gives the next available chunk, preferring the ones of the worker's NUMA node
+ * lock free, each queue cursor is advanced with an atomic fetch and add
+ * returns !0 if no next chunk available (the thread should end, no more work to do)
+ * */
+static int distributor(int node, struct chunk **chunk) {
+  for (int i = 0; i < queues_c; i++) {
+    struct queue *q = &queues[(node + i) % queues_c];
+    if (__atomic_load_n(&q->next, __ATOMIC_RELAXED) >= q->end)
+      continue;
+    int c = __atomic_fetch_add(&q->next, 1, __ATOMIC_RELAXED);
+    if (c < q->end) {
+      *chunk = &chunks[c];
+      return 0;
+    }
+  }
+  return 1; // all files read
+}
 
-  FILE *fd;
-  int err, n, local_words = 0, local_consonants = 0;
-  int found_words = 0, found_consonants = 0;
-  int fdt = 0, fdt_start;
-  int current_file = -1; 
-
-  while (True) { // each loop handles a sub sequence
-    int file_index;
-    err = distributor(&fd, &file_index); 
-    if (current_file != file_index) {
-      if (current_file != -1) {
-        printf("\nFile name: %s\n", files[current_file]);
-        printf("Number of words: %d\n", local_words);
-        printf("Number of words with at least two instances of the same consonant: %d\n", local_consonants);
+/*
+ * counts the chunks handed out by the distributor into this worker's row of the results
+ * */
+static void countChunks(struct worker_st *st, char *iobuf) {
+  struct file_result *row = st->shm->results + (long)st->id * files_c; // only written by this worker
+
+  FILE *fd = NULL;
+  int n;
+  struct metrics *local = NULL, found, tail;
+  long fdt = 0, fdt_start;
+  int current_file = -1;
+  struct chunk *chunk;
+
+  while (distributor(st->node, &chunk) == 0) { // each loop handles a sub sequence
+    if (current_file != chunk->file) {
+      if (fd != NULL) {
+        fclose(fd);
+      }
+      current_file = chunk->file;
+      local = &row[current_file].m;
+      fd = openInput(&files[current_file]);
+      if (fd == NULL) { // removed since the job started, it is reported with the chunks counted so far
+        continue;
       }
-      current_file = file_index;
-      local_words = 0;
-      local_consonants = 0;
+      setvbuf(fd, iobuf, _IOFBF, IO_BUFFER_SIZE);
     }
-    fdt_start = ftell(fd);
-    fdt = ftell(fd);
-    if (err) { 
-      break;
+    if (fd == NULL) {
+      continue;
     }
+    fseek(fd, chunk->start, SEEK_SET);
+    fdt_start = chunk->start;
+    fdt = fdt_start;
 
-    // count all the sub sequence words and consonants
-    while (fdt < fdt_start + BUFFER_SIZE) {
-      n = nextWord(fd, &found_words, &found_consonants);
-      local_words += found_words;
-      local_consonants += found_consonants;
+    // count all the sub sequence metrics
+    while (fdt < fdt_start + chunk_s) {
+      n = nextWord(fd, &found);
+      metricsAdd(local, &found, 1);
       fdt = ftell(fd);
       if (n == -1) // EOF
         break;
     }
 
     // handle duplication of intersecting word (word that is in 2 different sub-sequences)
-    if (fdt > fdt_start + BUFFER_SIZE + 1) {
-      local_words--;
-      if (found_consonants == 1) {
-        fseek(fd, fdt_start + BUFFER_SIZE, SEEK_SET);
-        nextWord(fd, &found_words, &found_consonants);
-        local_consonants -= found_consonants;
+    // the next sub sequence counts whatever it reads from the boundary up to the end of this word, remove it from here
+    if (fdt > fdt_start + chunk_s + 1) {
+      long end = fdt;
+      fseek(fd, fdt_start + chunk_s, SEEK_SET);
+      do {
+        nextWord(fd, &tail);
+        metricsAdd(local, &tail, -1);
+      } while (ftell(fd) < end);
+    }
+  }
+  if (fd != NULL) {
+    fclose(fd);
+  }
+}
+
+// GLOBAL VARIABLES of the pattern mode
+long *chunk_matches; // counts of each chunk, MATCH_FIELDS per chunk
+long *file_matches;  // the chunks merged in order, MATCH_FIELDS per file
+
+/*
+ * pattern mode: counts the matches of the chunks handed out by the distributor
+ * every chunk is read with the bytes after it that a match starting in it may need
+ * */
+static void matchChunks(struct worker_st *st, char *iobuf) {
+  int fields = MATCH_FIELDS(matcher->patterns_c);
+  long size = chunk_s + matcher->max_length - 1;
+  uint8_t *buf = size <= IO_BUFFER_SIZE ? (uint8_t *)iobuf : (uint8_t *)malloc(size);
+  FILE *fd = NULL;
+  int current_file = -1;
+  struct chunk *chunk;
+
+  while (distributor(st->node, &chunk) == 0) {
+    long *counts = chunk_matches + (chunk - chunks) * fields;
+    if (current_file != chunk->file) {
+      if (fd != NULL) {
+        fclose(fd);
+      }
+      current_file = chunk->file;
+      fd = openInput(&files[current_file]);
+      if (fd != NULL) {
+        setvbuf(fd, NULL, _IONBF, 0); // read straight into buf
       }
     }
+    if (fd == NULL) {
+      memset(counts, 0, fields * sizeof(long));
+      continue;
+    }
+    fseek(fd, chunk->start, SEEK_SET);
+    long len = fread(buf, 1, size, fd);
+    matchChunk(matcher, buf, len < chunk_s ? len : chunk_s, len, counts);
+  }
+  if (fd != NULL) {
+    fclose(fd);
   }
-  // Print last file
-  if (current_file != -1) {
-    printf("\nFile name: %s\n", files[current_file]);
-    printf("Number of words: %d\n", local_words);
-    printf("Number of words with at least two instances of the same consonant: %d\n", local_consonants);
+  if (buf != (uint8_t *)iobuf) {
+    free(buf);
   }
+}
 
-  // update shared words and consonants (mutual exclusion)
-  pthread_mutex_lock(&st->shm->mutex);
-  *st->shm->words += local_words;
-  *st->shm->consonants += local_consonants;
-  pthread_mutex_unlock(&st->shm->mutex);
+/*
+ * persistent worker, waits for a job, runs it and waits for the next one
+ * */
+void *worker(void *args) {
+  struct worker_st *st = (struct worker_st *)args;
+  struct worker_shm *shm = st->shm;
+  int seen = 0;
+
+  // allocated (and first touched) by the worker, so it stays on the worker's node
+  char *iobuf = (char *)malloc(IO_BUFFER_SIZE);
 
+  while (True) {
+    pthread_mutex_lock(&shm->mutex);
+    while (shm->generation == seen && !shm->shutdown) {
+      pthread_cond_wait(&shm->start, &shm->mutex);
+    }
+    if (shm->shutdown) {
+      pthread_mutex_unlock(&shm->mutex);
+      break;
+    }
+    seen = shm->generation;
+    pthread_mutex_unlock(&shm->mutex);
+
+    shm->job(st, iobuf);
+
+    pthread_mutex_lock(&shm->mutex);
+    if (--shm->running == 0) {
+      pthread_cond_signal(&shm->done);
+    }
+    pthread_mutex_unlock(&shm->mutex);
+  }
+
+  free(iobuf);
   return 0;
 }
 
-int main(int argc, char *argv[]) {
-  if (argc < 3) {
-    printf("Insufficient number of arguments!\n");
+/*
+ * runs a job on every worker of the pool and waits for all of them to finish it
+ * */
+static void runPool(struct worker_shm *shm, void (*job)(struct worker_st *st, char *iobuf)) {
+  pthread_mutex_lock(&shm->mutex);
+  shm->job = job;
+  shm->running = shm->thread_c;
+  shm->generation++;
+  pthread_cond_broadcast(&shm->start);
+  while (shm->running > 0) {
+    pthread_cond_wait(&shm->done, &shm->mutex);
+  }
+  pthread_mutex_unlock(&shm->mutex);
+}
+
+/*
+ * encoding detection and UTF-8 validation of one input, done before counting it
+ * */
+struct input_check {
+  int failed; // CHECK_OPEN_FAILED if the file could not be read, CHECK_NO_MEMORY if its copy did not fit
+  enum encoding encoding;
+  struct utf8_errors errors;
+  uint8_t *fixed; // UTF-8 copy that is counted instead, NULL to count the input as it is
+  long fixed_s;
+};
+
+#define CHECK_OPEN_FAILED 1
+#define CHECK_NO_MEMORY 2
+
+// GLOBAL VARIABLES of the validation
+struct input_check *checks; // one per input of the current job
+int next_check;             // next input to validate, advanced atomically
+
+/*
+ * transcodes a UTF-16LE or Latin-1 file to UTF-8 block by block, from its byte start up to end
+ * with out NULL the output is only measured (and the errors recorded) and end is set to the
+ * length of the file; otherwise at most cap bytes are written, what changed since is left out
+ * returns the length of the output, -1 if there is no memory to measure it
+ * */
+static long transcodeFile(FILE *fd, long start, long *end, enum encoding enc, uint8_t *buf, uint8_t *out, long cap,
+                          struct utf8_errors *errors) {
+  uint8_t *block_out = out == NULL ? (uint8_t *)malloc(transcodedSize(enc, IO_BUFFER_SIZE)) : NULL;
+  long offset = start, carry = 0, out_s = 0;
+  int last;
+
+  if (out == NULL && block_out == NULL)
+    return -1;
+  fseek(fd, start, SEEK_SET);
+  do {
+    long want = IO_BUFFER_SIZE - carry;
+    if (out != NULL && want > *end - offset - carry)
+      want = *end - offset - carry;
+    long got = fread(buf + carry, 1, want, fd);
+    long len = carry + got, block_s;
+    last = got < want || feof(fd) || ferror(fd) || (out != NULL && offset + len == *end);
+    if (out != NULL && out_s + transcodedSize(enc, len) > cap)
+      break; // the file changed since it was measured
+    long done = transcodeUTF8(buf, len, last, offset, enc, policy, out != NULL ? out + out_s : block_out, &block_s, errors);
+    out_s += block_s;
+    carry = len - done; // a code unit or a surrogate pair cut by the end of the buffer starts the next block
+    memmove(buf, buf + done, carry);
+    offset += done;
+  } while (!last);
+
+  if (out == NULL)
+    *end = offset;
+  free(block_out);
+  return out_s;
+}
+
+/*
+ * copies a UTF-8 file with its bad sequences fixed, block by block, into out
+ * size is the length of the file when it was validated, what was appended since is left out
+ * */
+static long fixFile(FILE *fd, long size, uint8_t *buf, uint8_t *out) {
+  long left = size, carry = 0, out_s = 0;
+  int last;
+
+  rewind(fd);
+  do {
+    long want = IO_BUFFER_SIZE - carry < left ? IO_BUFFER_SIZE - carry : left;
+    long got = fread(buf + carry, 1, want, fd);
+    long len = carry + got, fixed_s;
+    left -= got;
+    last = left == 0 || got < want;
+    long done = utf8Fix(buf, len, last, policy, out + out_s, &fixed_s);
+    out_s += fixed_s;
+    carry = len - done; // a sequence cut by the end of the buffer starts the next block
+    memmove(buf, buf + done, carry);
+  } while (!last);
+  return out_s;
+}
+
+/*
+ * validates an input and, if the policy allows it, builds the copy that is counted
+ * files are never loaded: UTF-8 ones are validated and fixed block by block,
+ * UTF-16LE and Latin-1 ones are transcoded block by block into the UTF-8 copy that is counted
+ * */
+static void checkInput(struct input *in, struct input_check *check, char *iobuf) {
+  uint8_t *buf = (uint8_t *)iobuf;
+  uint8_t *data = in->data;
+  long size = in->size;
+  FILE *fd = NULL;
+  long head;
+  int bom_s;
+
+  memset(check, 0, sizeof(struct input_check));
+  if (data != NULL) {
+    check->encoding = detectEncoding(data, size, encoding, &bom_s);
+  } else {
+    fd = fopen(in->name, "rb");
+    if (fd == NULL) {
+      check->failed = CHECK_OPEN_FAILED;
+      return;
+    }
+    setvbuf(fd, NULL, _IONBF, 0); // read straight into the worker's buffer
+    head = fread(buf, 1, MAX_BOM_SIZE, fd);
+    check->encoding = detectEncoding(buf, head, encoding, &bom_s);
+  }
+
+  if (check->encoding == ENCODING_UTF8) { // a UTF-8 byte order mark reads as a delimiter, it is left in
+    if (data != NULL) {
+      utf8Validate(data, size, 0, True, &check->errors);
+    } else {
+      long offset = 0, carry = head;
+      int last;
+      do {
+        long len = carry + fread(buf + carry, 1, IO_BUFFER_SIZE - carry, fd);
+        last = feof(fd) || ferror(fd);
+        long done = utf8Validate(buf, len, offset, last, &check->errors);
+        carry = len - done; // a sequence cut by the end of the buffer starts the next block
+        memmove(buf, buf + done, carry);
+        offset += done;
+      } while (!last);
+      size = offset;
+    }
+
+    if (check->errors.count > 0 && policy != UTF8_REJECT) {
+      // a bad sequence of 1 to 3 bytes grows to at most the 3 of U+FFFD
+      check->fixed = (uint8_t *)malloc(size + 2 * check->errors.count + 1);
+      if (check->fixed == NULL) {
+        check->failed = CHECK_NO_MEMORY;
+      } else if (fd != NULL) {
+        check->fixed_s = fixFile(fd, size, buf, check->fixed);
+      } else {
+        utf8Fix(data, size, True, policy, check->fixed, &check->fixed_s);
+      }
+    }
+
+  } else if (data != NULL) {
+    check->fixed = (uint8_t *)malloc(transcodedSize(check->encoding, size - bom_s) + 1);
+    if (check->fixed == NULL) {
+      check->failed = CHECK_NO_MEMORY;
+    } else {
+      transcodeUTF8(data + bom_s, size - bom_s, True, bom_s, check->encoding, policy, check->fixed, &check->fixed_s, &check->errors);
+      if (check->errors.count > 0 && policy == UTF8_REJECT) {
+        free(check->fixed);
+        check->fixed = NULL;
+      }
+    }
+
+  } else {
+    // measured first, then transcoded into a copy of that size (and the slack of a block)
+    long end;
+    long measured = transcodeFile(fd, bom_s, &end, check->encoding, buf, NULL, 0, &check->errors);
+    if (measured < 0) {
+      check->failed = CHECK_NO_MEMORY;
+    } else if (check->errors.count == 0 || policy != UTF8_REJECT) {
+      long cap = measured + transcodedSize(check->encoding, IO_BUFFER_SIZE);
+      struct utf8_errors again = {0}; // already recorded
+      check->fixed = (uint8_t *)malloc(cap + 1);
+      if (check->fixed == NULL) {
+        check->failed = CHECK_NO_MEMORY;
+      } else {
+        check->fixed_s = transcodeFile(fd, bom_s, &end, check->encoding, buf, check->fixed, cap, &again);
+      }
+    }
+  }
+
+  if (fd != NULL) {
+    fclose(fd);
+  }
+}
+
+/*
+ * validation job, the inputs are handed out whole to the workers
+ * */
+static void checkInputs(struct worker_st *st, char *iobuf) {
+  int i;
+  while ((i = __atomic_fetch_add(&next_check, 1, __ATOMIC_RELAXED)) < files_c) {
+    checkInput(&files[i], &checks[i], iobuf);
+  }
+}
+
+/*
+ * writes the offsets (in the input) of the bad sequences of an input
+ * */
+static void printErrors(FILE *out, const char *level, const char *name, enum encoding enc, struct utf8_errors *errors) {
+  fprintf(out, "%s invalid %s in %s: %ld bad sequence%s at byte", level, enc == ENCODING_UTF16LE ? "UTF-16LE" : "UTF-8", name, errors->count, errors->count == 1 ? "" : "s");
+  for (long e = 0; e < errors->count && e < MAX_REPORTED_ERRORS; e++) {
+    fprintf(out, "%s %ld (%d byte%s)", e == 0 ? "" : ",", errors->offset[e], errors->length[e], errors->length[e] == 1 ? "" : "s");
+  }
+  fprintf(out, "%s\n", errors->count > MAX_REPORTED_ERRORS ? ", ..." : "");
+}
+
+/*
+ * vocabulary mode: the words of a worker, folded as the counter sees them
+ * */
+struct word_list {
+  char *chars; // the words one after the other, NUL terminated
+  long chars_c;
+  long chars_max;
+  long words_c;
+} __attribute__((aligned(64)));
+
+#define TOP_BUCKETS (1 << 16) // the first 2 bytes of the words are sorted in parallel
+
+// GLOBAL VARIABLES of the vocabulary mode
+char *vocabulary_path = NULL; // sorted words are written here
+int vocabulary_unique = False;
+struct word_list *word_lists; // one per worker
+struct word_ref *vocabulary;  // references to all the words
+struct word_ref *vocabulary_tmp;
+long vocabulary_c;
+long *ref_start;     // first reference of each worker
+long *bucket_next;   // TOP_BUCKETS per worker: counts, then where the worker's next word of each bucket goes
+long *bucket_start;  // TOP_BUCKETS + 1
+int next_bucket;     // next bucket to sort, advanced atomically
+
+/*
+ * !0 if the character that starts at buf is part of a word (letter or merger)
+ * */
+static int wordCharAt(const uint8_t *buf) {
+  union UTF8 utf;
+  int n = 1;
+
+  utf.code = 0;
+  if ((buf[0] & 0b11100000) == 0b11000000)
+    n = 2;
+  else if ((buf[0] & 0b11110000) == 0b11100000)
+    n = 3;
+  else if ((buf[0] & 0b11111000) == 0b11110000)
+    n = 4;
+  for (int i = 0; i < n; i++)
+    utf.bytes[3 - i] = buf[i];
+  removeAccentuation(&utf);
+  return isWordLetter(&utf) || isMergerLetter(&utf);
+}
+
+/*
+ * ends the word being extracted, leading and trailing mergers (quotes) are dropped
+ * and words without letters are discarded
+ * */
+static void endWord(struct word_list *list, long word, int letters) {
+  if (letters == 0) {
+    list->chars_c = word;
+    return;
+  }
+  while (list->chars[list->chars_c - 1] == '\'')
+    list->chars_c--;
+  long lead = 0;
+  while (list->chars[word + lead] == '\'')
+    lead++;
+  memmove(list->chars + word, list->chars + word + lead, list->chars_c - word - lead);
+  list->chars_c -= lead;
+  list->chars[list->chars_c++] = '\0';
+  list->words_c++;
+}
+
+/*
+ * vocabulary mode: extracts the words that start in the chunks handed out by the
+ * distributor, a word is read to its end even if it goes past the chunk
+ * */
+static void extractChunks(struct worker_st *st, char *iobuf) {
+  struct word_list *list = &word_lists[st->id];
+  union UTF8 utf;
+  FILE *fd = NULL;
+  int current_file = -1;
+  struct chunk *chunk;
+
+  list->chars_c = 0;
+  list->words_c = 0;
+  while (distributor(st->node, &chunk) == 0) {
+    if (current_file != chunk->file) {
+      if (fd != NULL) {
+        fclose(fd);
+      }
+      current_file = chunk->file;
+      fd = openInput(&files[current_file]);
+      if (fd != NULL) {
+        setvbuf(fd, iobuf, _IOFBF, IO_BUFFER_SIZE);
+      }
+    }
+    if (fd == NULL) {
+      continue;
+    }
+
+    // the first character that starts in the chunk, skipped to the end of its word if the word started before
+    long pos = chunk->start, end = chunk->start + chunk_s;
+    int skipping = False;
+    if (pos > 0) {
+      uint8_t window[16] = {0};
+      long from = pos >= 4 ? pos - 4 : 0;
+      fseek(fd, from, SEEK_SET);
+      long got = fread(window, 1, 12, fd);
+      long k = pos - from, prev;
+      while (k < got && (window[k] & 0b11000000) == 0b10000000)
+        k++;
+      for (prev = k - 1; prev > 0 && (window[prev] & 0b11000000) == 0b10000000; prev--)
+        ;
+      pos = from + k;
+      skipping = k < got && wordCharAt(window + prev) && wordCharAt(window + k);
+    }
+    fseek(fd, pos, SEEK_SET);
+
+    long word = list->chars_c;
+    int letters = 0;
+    while (True) {
+      long at = pos;
+      int n = nextUTF8(fd, &utf);
+      if (n == -1) {
+        endWord(list, word, letters);
+        break;
+      }
+      pos += n;
+      removeAccentuation(&utf);
+      int letter = isWordLetter(&utf);
+
+      if (letter || isMergerLetter(&utf)) {
+        if (skipping)
+          continue;
+        if (list->chars_c == word && at >= end)
+          break; // the word starts in the next chunk
+        if (list->chars_c + 2 > list->chars_max) {
+          list->chars_max = list->chars_max ? list->chars_max * 2 : IO_BUFFER_SIZE;
+          list->chars = (char *)realloc(list->chars, list->chars_max);
+        }
+        list->chars[list->chars_c++] = letter ? (char)utf.bytes[3] : '\''; // all the quotes fold to '
+        letters += letter;
+      } else {
+        skipping = False;
+        endWord(list, word, letters);
+        word = list->chars_c;
+        letters = 0;
+        if (pos >= end)
+          break;
+      }
+    }
+  }
+  if (fd != NULL) {
+    fclose(fd);
+  }
+}
+
+/*
+ * first 2 bytes of a word, the bucket of the parallel pass
+ * */
+static inline long topBucket(const struct word_ref *w) {
+  return (long)(w->prefix >> (8 * (PREFIX_SIZE - 2)));
+}
+
+/*
+ * vocabulary mode: references the words of this worker and counts them per bucket
+ * */
+static void referenceWords(struct worker_st *st, char *iobuf) {
+  struct word_list *list = &word_lists[st->id];
+  struct word_ref *ref = vocabulary + ref_start[st->id];
+  long *count = bucket_next + (long)st->id * TOP_BUCKETS;
+
+  memset(count, 0, TOP_BUCKETS * sizeof(long));
+  for (long c = 0; c < list->chars_c; ref++) {
+    ref->str = list->chars + c;
+    ref->len = strlen(ref->str);
+    ref->prefix = wordPrefix(ref->str, ref->len);
+    count[topBucket(ref)]++;
+    c += ref->len + 1;
+  }
+}
+
+/*
+ * vocabulary mode: moves the references of this worker to their buckets
+ * */
+static void scatterWords(struct worker_st *st, char *iobuf) {
+  struct word_ref *ref = vocabulary + ref_start[st->id];
+  long *next = bucket_next + (long)st->id * TOP_BUCKETS;
+
+  for (long i = 0; i < word_lists[st->id].words_c; i++) {
+    vocabulary_tmp[next[topBucket(&ref[i])]++] = ref[i];
+  }
+}
+
+/*
+ * vocabulary mode: sorts the buckets handed out one at a time, the result is left in vocabulary_tmp
+ * */
+static void sortBuckets(struct worker_st *st, char *iobuf) {
+  int b;
+  while ((b = __atomic_fetch_add(&next_bucket, 1, __ATOMIC_RELAXED)) < TOP_BUCKETS) {
+    long n = bucket_start[b + 1] - bucket_start[b];
+    if (n > 1)
+      msdSort(vocabulary_tmp + bucket_start[b], vocabulary + bucket_start[b], n, 2);
+  }
+}
+
+/*
+ * vocabulary mode: extracts the words of the inputs, sorts them in parallel and writes them one per line
+ * returns !0 if the vocabulary file can not be written (the error is written to err)
+ * */
+static int buildVocabulary(struct worker_shm *shm, FILE *err) {
+  int thread_c = shm->thread_c;
+
+  if (word_lists == NULL) {
+    word_lists = (struct word_list *)aligned_alloc(64, thread_c * sizeof(struct word_list));
+    memset(word_lists, 0, thread_c * sizeof(struct word_list));
+    ref_start = (long *)malloc(thread_c * sizeof(long));
+    bucket_next = (long *)malloc((long)thread_c * TOP_BUCKETS * sizeof(long));
+    bucket_start = (long *)malloc((TOP_BUCKETS + 1) * sizeof(long));
+  }
+
+  rewindQueues();
+  runPool(shm, extractChunks);
+
+  vocabulary_c = 0;
+  for (int t = 0; t < thread_c; t++) {
+    ref_start[t] = vocabulary_c;
+    vocabulary_c += word_lists[t].words_c;
+  }
+  vocabulary = (struct word_ref *)malloc((vocabulary_c + 1) * sizeof(struct word_ref));
+  vocabulary_tmp = (struct word_ref *)malloc((vocabulary_c + 1) * sizeof(struct word_ref));
+  runPool(shm, referenceWords);
+
+  // each worker scatters its words right after the ones of the workers before it, bucket by bucket
+  long start = 0;
+  for (long b = 0; b < TOP_BUCKETS; b++) {
+    bucket_start[b] = start;
+    for (int t = 0; t < thread_c; t++) {
+      long count = bucket_next[(long)t * TOP_BUCKETS + b];
+      bucket_next[(long)t * TOP_BUCKETS + b] = start;
+      start += count;
+    }
+  }
+  bucket_start[TOP_BUCKETS] = start;
+  runPool(shm, scatterWords);
+
+  next_bucket = 0;
+  runPool(shm, sortBuckets);
+
+  long n = vocabulary_unique ? dropDuplicates(vocabulary_tmp, vocabulary_c) : vocabulary_c;
+  FILE *out = fopen(vocabulary_path, "wb");
+  if (out != NULL) {
+    for (long i = 0; i < n; i++) {
+      fwrite(vocabulary_tmp[i].str, 1, vocabulary_tmp[i].len, out);
+      fputc('\n', out);
+    }
+    fclose(out);
+  } else {
+    fprintf(err, "ERROR opening file: %s\n", vocabulary_path);
+  }
+
+  free(vocabulary);
+  free(vocabulary_tmp);
+  return out == NULL;
+}
+
+/*
+ * counts a set of inputs with the worker pool, the counts are left in shm->results
+ * the inputs are validated first, bad sequences are reported to err (rejected
+ * inputs) or stderr (replaced or skipped)
+ * returns !0 if an input can not be opened or is rejected (the error is written to err)
+ * */
+static int runJob(struct worker_shm *shm, int nodes_c, struct input *inputs, int inputs_c, FILE *err) {
+  static long results_max = 0;
+  static int inputs_max = 0;
+  static struct input *fixed_inputs;
+  int failed = 0;
+
+  files = inputs;
+  files_c = inputs_c;
+  if (files_c > inputs_max) {
+    inputs_max = files_c;
+    checks = (struct input_check *)realloc(checks, inputs_max * sizeof(struct input_check));
+    fixed_inputs = (struct input *)realloc(fixed_inputs, inputs_max * sizeof(struct input));
+  }
+
+  next_check = 0;
+  runPool(shm, checkInputs);
+
+  for (int i = 0; i < files_c; i++) {
+    fixed_inputs[i] = inputs[i];
+    if (checks[i].failed) {
+      fprintf(err, checks[i].failed == CHECK_NO_MEMORY ? "ERROR out of memory for file: %s\n" : "ERROR opening file: %s\n", inputs[i].name);
+      failed = 1;
+    } else if (checks[i].errors.count > 0 && policy == UTF8_REJECT) {
+      printErrors(err, "ERROR", inputs[i].name, checks[i].encoding, &checks[i].errors);
+      failed = 1;
+    } else {
+      if (checks[i].errors.count > 0) {
+        printErrors(stderr, "WARNING", inputs[i].name, checks[i].encoding, &checks[i].errors);
+      }
+      if (checks[i].fixed != NULL) {
+        fixed_inputs[i].data = checks[i].fixed;
+        fixed_inputs[i].size = checks[i].fixed_s;
+      }
+    }
+  }
+
+  files = fixed_inputs;
+  if (!failed && buildChunks(nodes_c, err) != 0) {
+    failed = 1;
+  }
+
+  if (!failed && matcher != NULL) {
+    static int chunks_max = 0;
+    int fields = MATCH_FIELDS(matcher->patterns_c);
+    if (chunks_c > chunks_max) {
+      chunks_max = chunks_c;
+      chunk_matches = (long *)realloc(chunk_matches, (long)chunks_max * fields * sizeof(long));
+    }
+    file_matches = (long *)realloc(file_matches, (long)files_c * fields * sizeof(long));
+    memset(file_matches, 0, (long)files_c * fields * sizeof(long));
+
+    runPool(shm, matchChunks);
+
+    // the chunk table is in file order, the lines that cross chunks are joined here
+    for (int c = 0; c < chunks_c; c++) {
+      mergeMatches(matcher, file_matches + (long)chunks[c].file * fields, chunk_matches + (long)c * fields);
+    }
+    for (int i = 0; i < files_c; i++) {
+      finishMatches(file_matches + (long)i * fields);
+    }
+
+  } else if (!failed) {
+    long results_c = (long)shm->thread_c * files_c;
+    if (results_c > results_max) {
+      free(shm->results);
+      results_max = results_c;
+      shm->results = (struct file_result *)aligned_alloc(64, results_max * sizeof(struct file_result));
+    }
+    memset(shm->results, 0, results_c * sizeof(struct file_result));
+
+    runPool(shm, countChunks);
+
+    if (vocabulary_path != NULL && buildVocabulary(shm, err) != 0) {
+      failed = 1;
+    }
+  }
+
+  for (int i = 0; i < files_c; i++) {
+    free(checks[i].fixed);
+  }
+  files = inputs;
+  return failed;
+}
+
+/*
+ * writes a string as a JSON string or a CSV field
+ * */
+static void printQuoted(FILE *out, enum output_format format, const char *str) {
+  fputc('"', out);
+  for (const char *c = str; *c != '\0'; c++) {
+    if (format == OUTPUT_CSV) {
+      if (*c == '"')
+        fputc('"', out);
+      fputc(*c, out);
+    } else if (*c == '"' || *c == '\\') {
+      fprintf(out, "\\%c", *c);
+    } else if ((uint8_t)*c < 0x20) {
+      fprintf(out, "\\u%04x", *c);
+    } else {
+      fputc(*c, out);
+    }
+  }
+  fputc('"', out);
+}
+
+/*
+ * sums the rows of all the workers into the counts of each file of the last job
+ * */
+static void sumResults(struct file_result *results, int thread_c, struct metrics *totals) {
+  memset(totals, 0, files_c * sizeof(struct metrics));
+  for (int t = 0; t < thread_c; t++) {
+    for (int i = 0; i < files_c; i++) {
+      metricsAdd(&totals[i], &results[(long)t * files_c + i].m, 1);
+    }
+  }
+}
+
+/*
+ * prints the counts of each file in the command line order
+ * */
+static void printTotals(FILE *out, enum output_format format, struct input *inputs, int inputs_c, struct metrics *totals) {
+  if (format == OUTPUT_JSON)
+    fprintf(out, "[");
+  if (format == OUTPUT_CSV) {
+    fprintf(out, "file");
+    metricsFields(out, format, NULL);
+    fprintf(out, "\n");
+  }
+
+  for (int i = 0; i < inputs_c; i++) {
+    switch (format) {
+    case OUTPUT_TEXT:
+      fprintf(out, "\nFile name: %s\n", inputs[i].name);
+      metricsPrint(out, &totals[i]);
+      break;
+    case OUTPUT_JSON:
+      fprintf(out, "%s\n  {\"file\": ", i == 0 ? "" : ",");
+      printQuoted(out, format, inputs[i].name);
+      metricsFields(out, format, &totals[i]);
+      fprintf(out, "}");
+      break;
+    case OUTPUT_CSV:
+      printQuoted(out, format, inputs[i].name);
+      metricsFields(out, format, &totals[i]);
+      fprintf(out, "\n");
+      break;
+    }
+  }
+
+  if (format == OUTPUT_JSON)
+    fprintf(out, "\n]\n");
+}
+
+/*
+ * pattern mode: prints the matching lines and the occurrences of each pattern of each file
+ * */
+static void printMatches(FILE *out, enum output_format format) {
+  int fields = MATCH_FIELDS(matcher->patterns_c);
+
+  if (format == OUTPUT_JSON)
+    fprintf(out, "[");
+  if (format == OUTPUT_CSV) {
+    fprintf(out, "file,lines");
+    for (int k = 0; k < matcher->patterns_c; k++) {
+      fputc(',', out);
+      printQuoted(out, format, matcher->patterns[k]);
+    }
+    fprintf(out, "\n");
+  }
+
+  for (int i = 0; i < files_c; i++) {
+    long *counts = file_matches + (long)i * fields;
+    switch (format) {
+    case OUTPUT_TEXT:
+      fprintf(out, "\nFile name: %s\n", files[i].name);
+      fprintf(out, "Number of lines with a match: %ld\n", counts[MATCH_LINES]);
+      for (int k = 0; k < matcher->patterns_c; k++) {
+        fprintf(out, "Occurrences of \"%s\": %ld\n", matcher->patterns[k], counts[MATCH_OCCURRENCES + k]);
+      }
+      break;
+    case OUTPUT_JSON:
+      fprintf(out, "%s\n  {\"file\": ", i == 0 ? "" : ",");
+      printQuoted(out, format, files[i].name);
+      fprintf(out, ", \"lines\": %ld, \"occurrences\": {", counts[MATCH_LINES]);
+      for (int k = 0; k < matcher->patterns_c; k++) {
+        fprintf(out, "%s", k == 0 ? "" : ", ");
+        printQuoted(out, format, matcher->patterns[k]);
+        fprintf(out, ": %ld", counts[MATCH_OCCURRENCES + k]);
+      }
+      fprintf(out, "}}");
+      break;
+    case OUTPUT_CSV:
+      printQuoted(out, format, files[i].name);
+      fprintf(out, ",%ld", counts[MATCH_LINES]);
+      for (int k = 0; k < matcher->patterns_c; k++) {
+        fprintf(out, ",%ld", counts[MATCH_OCCURRENCES + k]);
+      }
+      fprintf(out, "\n");
+      break;
+    }
+  }
+
+  if (format == OUTPUT_JSON)
+    fprintf(out, "\n]\n");
+}
+
+/*
+ * sums the rows of all the workers and prints the counts of each file of the last job
+ * (or the matches, in pattern mode)
+ * */
+static void report(FILE *out, enum output_format format, struct file_result *results, int thread_c) {
+  if (matcher != NULL) {
+    printMatches(out, format);
+    return;
+  }
+  struct metrics *totals = (struct metrics *)malloc((files_c + 1) * sizeof(struct metrics));
+  sumResults(results, thread_c, totals);
+  printTotals(out, format, files, files_c, totals);
+  free(totals);
+}
+
+/*
+ * follow mode: state of a followed file, everything before done is counted for
+ * good, the word that runs into the end of the file (the carry) starts at done
+ * and is counted again, from done, when more bytes are appended
+ * */
+struct followed {
+  int wd; // inotify watch
+  int changed;
+  int stale; // moved or removed, the name is looked up again every second
+  dev_t dev; // the file counted, a new one under the name is counted from its start
+  ino_t ino;
+  long done;
+  struct metrics committed; // words that end before done
+  struct metrics carry;     // the unfinished word at the end, counted as if the file ended there
+};
+
+#define FOLLOW_STEP (1024L * 1024 * 64) // most bytes of a file read at once, bigger appends take several steps
+#define FOLLOW_EVENTS (IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB | IN_MOVE_SELF | IN_DELETE_SELF)
+
+static volatile sig_atomic_t follow_stop = 0;
+
+static void onFollowSignal(int sig) {
+  follow_stop = 1;
+}
+
+/*
+ * length of buf without a sequence cut by its end (a writer may be in the middle of it)
+ * */
+static long completeSequences(const uint8_t *buf, long len) {
+  long start = len;
+  while (start > 0 && len - start < 3 && (buf[start - 1] & 0xC0) == 0x80)
+    start--;
+  if (start > 0 && utf8Sequence(buf + start - 1, len - start + 1) == 0)
+    return start - 1;
+  return len;
+}
+
+/*
+ * start of the word at the end of buf that is not followed by a delimiter yet, len if there is none
+ * */
+static long unfinishedWord(const uint8_t *buf, long len) {
+  union UTF8 utf;
+  long i = len;
+
+  while (i > 0) {
+    long start = i - 1;
+    while (start > 0 && i - start < 4 && (buf[start] & 0xC0) == 0x80)
+      start--;
+    int n = utf8Sequence(buf + start, i - start);
+    if (n <= 0 || start + n != i)
+      return i; // invalid bytes read as a delimiter
+    utf.code = 0;
+    for (int b = 0; b < n; b++)
+      utf.bytes[3 - b] = buf[start + b];
+    removeAccentuation(&utf);
+    if (!isWordLetter(&utf) && !isMergerLetter(&utf))
+      return i;
+    i = start;
+  }
+  return 0;
+}
+
+/*
+ * counts what was appended to the followed files since the last step, all the
+ * changed files are counted by the pool in one job
+ * returns the number of files that still have bytes to count
+ * */
+static int followStep(struct worker_shm *shm, int nodes_c, int notify, char **names, int names_c, struct followed *state, int *updated) {
+  struct input inputs[names_c];
+  int which[names_c];
+  int inputs_c = 0, pending = 0;
+
+  *updated = 0;
+  for (int i = 0; i < names_c; i++) {
+    if (!state[i].changed)
+      continue;
+    state[i].changed = 0;
+
+    FILE *fd = fopen(names[i], "rb");
+    if (fd == NULL) {
+      state[i].stale = 1; // removed or not created again yet, the totals are kept
+      continue;
+    }
+    struct stat st;
+    int replaced = 0;
+    if (fstat(fileno(fd), &st) == 0 && (st.st_dev != state[i].dev || st.st_ino != state[i].ino)) {
+      // first seen or replaced (e.g. rotated), watch the file now under the name
+      int wd = inotify_add_watch(notify, names[i], FOLLOW_EVENTS);
+      if (wd != -1 && wd != state[i].wd) {
+        inotify_rm_watch(notify, state[i].wd);
+        state[i].wd = wd;
+      }
+      replaced = state[i].ino != 0;
+      state[i].dev = st.st_dev;
+      state[i].ino = st.st_ino;
+    }
+    state[i].stale = 0;
+    fseek(fd, 0, SEEK_END);
+    long size = ftell(fd);
+    if (replaced || size < state[i].done) { // replaced or truncated, count it again
+      state[i].done = 0;
+      memset(&state[i].committed, 0, sizeof(struct metrics));
+      memset(&state[i].carry, 0, sizeof(struct metrics));
+    }
+    long len = size - state[i].done;
+    if (len > FOLLOW_STEP) {
+      len = FOLLOW_STEP;
+      state[i].changed = 1;
+      pending++;
+    }
+    if (len > 0) {
+      uint8_t *data = (uint8_t *)malloc(len + 1);
+      fseek(fd, state[i].done, SEEK_SET);
+      len = fread(data, 1, len, fd);
+      inputs[inputs_c].name = names[i];
+      inputs[inputs_c].data = data;
+      inputs[inputs_c].size = completeSequences(data, len);
+      which[inputs_c++] = i;
+    }
+    fclose(fd);
+  }
+  if (inputs_c == 0)
+    return pending;
+
+  struct metrics totals[inputs_c];
+  if (runJob(shm, nodes_c, inputs, inputs_c, stderr) == 0) {
+    sumResults(shm->results, shm->thread_c, totals);
+
+    for (int k = 0; k < inputs_c; k++) {
+      struct followed *f = &state[which[k]];
+      long end = inputs[k].size;
+      long tail = unfinishedWord(inputs[k].data, end);
+      if (tail == 0 && f->changed)
+        tail = end; // a single word longer than a step, it is split
+
+      memset(&f->carry, 0, sizeof(struct metrics));
+      if (tail < end) {
+        FILE *fd = fmemopen(inputs[k].data + tail, end - tail, "rb");
+        nextWord(fd, &f->carry);
+        fclose(fd);
+      }
+      metricsAdd(&f->committed, &totals[k], 1);
+      metricsAdd(&f->committed, &f->carry, -1);
+      f->done += tail;
+    }
+    *updated = 1;
+  }
+
+  for (int k = 0; k < inputs_c; k++) {
+    free(inputs[k].data);
+  }
+  return pending;
+}
+
+/*
+ * follow mode: counts the files and then only what is appended to them,
+ * printing the running totals after every change, until SIGINT or SIGTERM
+ * */
+static int followFiles(struct worker_shm *shm, int nodes_c, char **names, int names_c, enum output_format format) {
+  struct followed *state = (struct followed *)calloc(names_c, sizeof(struct followed));
+  struct input inputs[names_c];
+  struct metrics totals[names_c];
+  char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  struct sigaction sa;
+
+  int notify = inotify_init1(IN_CLOEXEC);
+  if (notify == -1) {
+    perror("inotify_init1");
+    free(state);
     return 1;
   }
-  files_c = argc - 2;
-  files = argv + 2;
+  for (int i = 0; i < names_c; i++) {
+    inputs[i].name = names[i];
+    state[i].wd = inotify_add_watch(notify, names[i], FOLLOW_EVENTS);
+    if (state[i].wd == -1) {
+      fprintf(stdout, "ERROR opening file: %s\n", names[i]);
+      close(notify);
+      free(state);
+      return 1;
+    }
+    state[i].changed = 1;
+  }
 
-  //printf("Reading %d files.\n", files_c);
-  // for (int i = 0; i < files_c; i++) {
-  //   printf("File %d: %s\n", i, files[i]);
-  // }
+  // no SA_RESTART, read must return on a signal so follow mode can stop
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_handler = onFollowSignal;
+  sigaction(SIGINT, &sa, NULL);
+  sigaction(SIGTERM, &sa, NULL);
+
+  while (!follow_stop) {
+    int updated;
+    int pending = followStep(shm, nodes_c, notify, names, names_c, state, &updated);
+    if (updated) {
+      for (int i = 0; i < names_c; i++) {
+        totals[i] = state[i].committed;
+        metricsAdd(&totals[i], &state[i].carry, 1);
+      }
+      printTotals(stdout, format, inputs, names_c, totals);
+      fflush(stdout);
+    }
+    if (pending > 0)
+      continue;
 
-  int words = 0, consonants = 0;
+    // a moved or removed file gets no events for what replaces it, wait at most a second
+    int stale = 0;
+    for (int i = 0; i < names_c; i++)
+      stale |= state[i].stale;
+    if (stale) {
+      struct pollfd pfd = {.fd = notify, .events = POLLIN};
+      if (poll(&pfd, 1, 1000) <= 0) {
+        for (int i = 0; i < names_c; i++)
+          state[i].changed |= state[i].stale;
+        continue;
+      }
+    }
+
+    ssize_t n = read(notify, events, sizeof(events));
+    for (char *e = events; n > 0 && e < events + n;) {
+      struct inotify_event *event = (struct inotify_event *)e;
+      for (int i = 0; i < names_c; i++) {
+        if (state[i].wd == event->wd) {
+          state[i].changed = 1;
+          if (event->mask & (IN_MOVE_SELF | IN_DELETE_SELF))
+            state[i].stale = 1;
+        }
+      }
+      e += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  close(notify);
+  free(state);
+  return 0;
+}
+
+// GLOBAL VARIABLES of the server mode
+struct worker_shm *server_shm;
+int server_nodes_c;
+
+/*
+ * server mode request: counts the inputs with the resident pool and writes the report
+ * */
+static int handleRequest(struct input *inputs, int inputs_c, enum output_format format, FILE *out) {
+  if (runJob(server_shm, server_nodes_c, inputs, inputs_c, out) != 0) {
+    return 1;
+  }
+  report(out, format, server_shm->results, server_shm->thread_c);
+  return 0;
+}
+
+static void help(char *cmdName) {
+  fprintf(stderr, "Usage: %s [OPTIONS] <thread count> <file>...\n"
+                  "       %s [OPTIONS] -s <socket> <thread count>\n"
+                  "       %s [OPTIONS] -f <thread count> <file>...\n"
+                  "OPTIONS:\n"
+                  "  -a      --- pin the workers: compact, scatter or a CPU list (e.g. 0,2,8-11)\n"
+                  "  -c      --- bytes per chunk (default %d)\n"
+                  "  -w      --- write the sorted words (accent folded, lower case) to a vocabulary file\n"
+                  "  -d      --- with -w, write each word once\n"
+                  "  -p      --- count the lines and occurrences of a literal instead of the words (repeatable)\n"
+                  "  -o      --- output format: text, json or csv (default text)\n"
+                  "  -s      --- serve count requests on a Unix domain socket (see server.h)\n"
+                  "  -u      --- invalid UTF-8 policy: reject, replace (with U+FFFD) or skip (default replace)\n"
+                  "  -f      --- follow the files: count what is appended to them and print the running totals\n"
+                  "  -e      --- input encoding: auto (byte order mark, else UTF-8), utf8, utf16le or latin1 (default auto)\n"
+                  "  -h      --- print this help\n",
+          cmdName, cmdName, cmdName, BUFFER_SIZE);
+}
+
+int main(int argc, char *argv[]) {
+  struct affinity aff = {AFFINITY_NONE, 0};
+  enum output_format format = OUTPUT_TEXT;
+  char *socket_path = NULL;
+  int follow = False;
+  char *patterns[MAX_PATTERNS];
+  int patterns_c = 0;
+  int opt;
+
+  while ((opt = getopt(argc, argv, "a:c:de:fo:p:s:u:w:h")) != -1) {
+    switch (opt) {
+    case 'a':
+      if (parseAffinity(optarg, &aff) != 0) {
+        fprintf(stderr, "Invalid affinity policy: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'c':
+      chunk_s = atol(optarg);
+      if (chunk_s < 1) {
+        fprintf(stderr, "Invalid chunk size: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'e':
+      if (parseEncoding(optarg, &encoding) != 0) {
+        fprintf(stderr, "Invalid encoding: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'd':
+      vocabulary_unique = True;
+      break;
+    case 'f':
+      follow = True;
+      break;
+    case 'w':
+      vocabulary_path = optarg;
+      break;
+    case 'o':
+      if (strcmp(optarg, "text") == 0) {
+        format = OUTPUT_TEXT;
+      } else if (strcmp(optarg, "json") == 0) {
+        format = OUTPUT_JSON;
+      } else if (strcmp(optarg, "csv") == 0) {
+        format = OUTPUT_CSV;
+      } else {
+        fprintf(stderr, "Invalid output format: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'p':
+      if (patterns_c == MAX_PATTERNS) {
+        fprintf(stderr, "Too many patterns, at most %d\n", MAX_PATTERNS);
+        return 1;
+      }
+      patterns[patterns_c++] = optarg;
+      break;
+    case 's':
+      socket_path = optarg;
+      break;
+    case 'u':
+      if (parsePolicy(optarg, &policy) != 0) {
+        fprintf(stderr, "Invalid UTF-8 policy: %s\n", optarg);
+        return 1;
+      }
+      break;
+    case 'h':
+      help(argv[0]);
+      return 0;
+    default:
+      help(argv[0]);
+      return 1;
+    }
+  }
+
+  if (patterns_c > 0) {
+    matcher = buildMatcher(patterns, patterns_c);
+    if (matcher == NULL) {
+      fprintf(stderr, "Invalid patterns: they must be distinct, not empty and without newlines\n");
+      return 1;
+    }
+  }
+  if (vocabulary_path != NULL && (socket_path != NULL || follow || matcher != NULL)) {
+    fprintf(stderr, "The vocabulary is only written when counting the words of the files once\n");
+    return 1;
+  }
+  if (follow && (socket_path != NULL || matcher != NULL || policy == UTF8_REJECT || (encoding != ENCODING_AUTO && encoding != ENCODING_UTF8))) {
+    fprintf(stderr, "Follow mode only counts the words of UTF-8 files, with the replace or skip policy and without -s\n");
+    return 1;
+  }
+  if (follow) {
+    encoding = ENCODING_UTF8; // appended ranges have no byte order mark to look at
+  }
+
+  if (argc - optind < (socket_path == NULL ? 2 : 1)) {
+    printf("Insufficient number of arguments!\n");
+    help(argv[0]);
+    return 1;
+  }
 
   // Threads variables
-  int thread_c = atoi(argv[1]);
+  int thread_c = atoi(argv[optind]);
   if (thread_c < 1) {
     printf("Invalid number of threads, thread count should be >1\n");
     return 2;
   }
   pthread_t threads[thread_c];
   struct worker_st worker_args[thread_c];
-  struct worker_shm workers_shm = {NULL, &words, &consonants, thread_c};
+  struct worker_shm workers_shm = {NULL, NULL, NULL, thread_c};
   pthread_mutex_init(&workers_shm.mutex, NULL);
+  pthread_cond_init(&workers_shm.start, NULL);
+  pthread_cond_init(&workers_shm.done, NULL);
 
-  get_delta_time();
-  // start threads
+  // one queue per NUMA node when the workers are pinned, a single shared queue otherwise
+  int nodes_c = aff.policy == AFFINITY_NONE ? 1 : nodeCount();
+
+  // start the worker pool, it waits for jobs until shutdown
   for (int j = 0; j < thread_c; j++) {
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
     worker_args[j].id = j;
+    worker_args[j].node = 0;
     worker_args[j].shm = &workers_shm;
-    pthread_create(&threads[j], NULL, worker, &worker_args[j]);
+
+    int cpu = affinityCpu(&aff, j);
+    if (cpu != -1) {
+      cpu_set_t set;
+      CPU_ZERO(&set);
+      CPU_SET(cpu, &set);
+      pthread_attr_setaffinity_np(&attr, sizeof(set), &set);
+      worker_args[j].node = cpuNode(cpu);
+    }
+    pthread_create(&threads[j], &attr, worker, &worker_args[j]);
+    pthread_attr_destroy(&attr);
   }
 
-  // wait for ending of threads
+  int err = 0;
+  if (socket_path != NULL) {
+    server_shm = &workers_shm;
+    server_nodes_c = nodes_c;
+    err = serve(socket_path, handleRequest) != 0 ? 4 : 0;
+
+  } else if (follow) {
+    err = followFiles(&workers_shm, nodes_c, argv + optind + 1, argc - optind - 1, format) != 0 ? 3 : 0;
+
+  } else {
+    int inputs_c = argc - optind - 1;
+    struct input inputs[inputs_c];
+    for (int i = 0; i < inputs_c; i++) {
+      inputs[i].name = argv[optind + 1 + i];
+      inputs[i].data = NULL;
+      inputs[i].size = 0;
+    }
+
+    get_delta_time();
+    if (runJob(&workers_shm, nodes_c, inputs, inputs_c, stdout) != 0) {
+      err = 3;
+    } else {
+      double elapsed = get_delta_time();
+
+      // single reporter, after the workers are done
+      report(stdout, format, workers_shm.results, thread_c);
+      // keep machine readable output clean
+      fprintf(format == OUTPUT_TEXT ? stdout : stderr, "\nTook %f seconds to run\n", elapsed);
+    }
+  }
+
+  // stop the pool
+  pthread_mutex_lock(&workers_shm.mutex);
+  workers_shm.shutdown = 1;
+  pthread_cond_broadcast(&workers_shm.start);
+  pthread_mutex_unlock(&workers_shm.mutex);
   for (int j = 0; j < thread_c; j++) {
     pthread_join(threads[j], NULL);
   }
 
-  printf("\nTook %f seconds to run\n", get_delta_time());
+  free(workers_shm.results);
+  free(chunks);
+  free(chunk_matches);
+  free(file_matches);
+  freeMatcher(matcher);
+  for (int t = 0; word_lists != NULL && t < thread_c; t++) {
+    free(word_lists[t].chars);
+  }
+  free(word_lists);
+  free(ref_start);
+  free(bucket_next);
+  free(bucket_start);
 
-  return 0;
-}
\ No newline at end of file
+  return err;
+}
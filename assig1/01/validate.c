@@ -0,0 +1,256 @@
+#include "validate.h"
+#include <string.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_SSSE3_PATH 1
+#endif
+
+int parsePolicy(const char *arg, enum utf8_policy *policy) {
+  if (strcmp(arg, "reject") == 0)
+    *policy = UTF8_REJECT;
+  else if (strcmp(arg, "replace") == 0)
+    *policy = UTF8_REPLACE;
+  else if (strcmp(arg, "skip") == 0)
+    *policy = UTF8_SKIP;
+  else
+    return -1;
+  return 0;
+}
+
+int utf8Sequence(const uint8_t *buf, long len) {
+  uint8_t c = buf[0];
+  uint8_t lo = 0x80, hi = 0xBF; // allowed range of the second byte
+  int n;
+
+  if (c < 0x80)
+    return 1;
+  if (c < 0xC2) // continuation byte or overlong 2 byte lead
+    return -1;
+  if (c < 0xE0) {
+    n = 2;
+  } else if (c < 0xF0) {
+    n = 3;
+    if (c == 0xE0)
+      lo = 0xA0; // overlong
+    else if (c == 0xED)
+      hi = 0x9F; // surrogates
+  } else if (c < 0xF5) {
+    n = 4;
+    if (c == 0xF0)
+      lo = 0x90; // overlong
+    else if (c == 0xF4)
+      hi = 0x8F; // above U+10FFFF
+  } else {
+    return -1;
+  }
+
+  for (int i = 1; i < n; i++) {
+    if (i >= len)
+      return 0;
+    if (buf[i] < lo || buf[i] > hi)
+      return -i;
+    lo = 0x80;
+    hi = 0xBF;
+  }
+  return n;
+}
+
+/*
+ * scalar prefix: skips ASCII 8 bytes at a time and stops at the first non ASCII byte
+ * */
+static long asciiPrefix(const uint8_t *buf, long len) {
+  long i = 0;
+  uint64_t word;
+
+  for (; i + 8 <= len; i += 8) {
+    memcpy(&word, buf + i, 8);
+    if (word & 0x8080808080808080ULL)
+      break;
+  }
+  while (i < len && buf[i] < 0x80)
+    i++;
+  return i;
+}
+
+#ifdef HAVE_SSSE3_PATH
+/*
+ * start of the sequence that byte i belongs to, i if no sequence before it runs into it
+ * */
+static long sequenceStart(const uint8_t *buf, long i) {
+  for (long j = i - 1; j >= 0 && j >= i - 3; j--) {
+    uint8_t c = buf[j];
+    if ((c & 0xC0) == 0x80)
+      continue;
+    int n = c >= 0xF0 ? 4 : c >= 0xE0 ? 3 : c >= 0xC0 ? 2 : 1;
+    return j + n > i ? j : i;
+  }
+  return i;
+}
+
+/*
+ * lookup validation (Keiser and Lemire, "Validating UTF-8 in less than one
+ * instruction per byte"): the error class of every pair of bytes comes from
+ * three 16 entry tables indexed by the nibbles of the previous and current
+ * byte, the 3rd and 4th byte of long sequences are checked from the bytes 2
+ * and 3 positions back
+ * */
+#define TOO_SHORT (1 << 0)  // lead byte not followed by a continuation
+#define TOO_LONG (1 << 1)   // continuation after an ASCII byte
+#define OVERLONG_3 (1 << 2) // E0 followed by 80..9F
+#define TOO_LARGE (1 << 3)  // above U+10FFFF
+#define SURROGATE (1 << 4)  // ED followed by A0..BF
+#define OVERLONG_2 (1 << 5) // C0 or C1 lead
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4 (1 << 6) // F0 followed by 80..8F
+#define TWO_CONTS (1 << 7)  // two continuations, only valid inside a 3 or 4 byte sequence
+#define CARRY (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+__attribute__((target("ssse3"))) static __m128i blockErrors(__m128i in, __m128i prev) {
+  const __m128i nibble = _mm_set1_epi8(0x0F);
+  const __m128i byte1High = _mm_setr_epi8(
+      TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+      TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+      TOO_SHORT | OVERLONG_2,
+      TOO_SHORT,
+      TOO_SHORT | OVERLONG_3 | SURROGATE,
+      TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+  const __m128i byte1Low = _mm_setr_epi8(
+      CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+      CARRY | OVERLONG_2,
+      CARRY,
+      CARRY,
+      CARRY | TOO_LARGE,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+      CARRY | TOO_LARGE | TOO_LARGE_1000,
+      CARRY | TOO_LARGE | TOO_LARGE_1000);
+  const __m128i byte2High = _mm_setr_epi8(
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+      TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+      TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+  __m128i prev1 = _mm_alignr_epi8(in, prev, 15);
+  __m128i special = _mm_and_si128(
+      _mm_and_si128(_mm_shuffle_epi8(byte1High, _mm_and_si128(_mm_srli_epi16(prev1, 4), nibble)),
+                    _mm_shuffle_epi8(byte1Low, _mm_and_si128(prev1, nibble))),
+      _mm_shuffle_epi8(byte2High, _mm_and_si128(_mm_srli_epi16(in, 4), nibble)));
+
+  // bytes that must be the 3rd or 4th byte of a sequence have the top bit set
+  __m128i third = _mm_subs_epu8(_mm_alignr_epi8(in, prev, 14), _mm_set1_epi8((char)(0xE0 - 0x80)));
+  __m128i fourth = _mm_subs_epu8(_mm_alignr_epi8(in, prev, 13), _mm_set1_epi8((char)(0xF0 - 0x80)));
+  __m128i must23 = _mm_and_si128(_mm_or_si128(third, fourth), _mm_set1_epi8((char)0x80));
+
+  return _mm_xor_si128(must23, special);
+}
+
+__attribute__((target("ssse3"))) static long ssse3Prefix(const uint8_t *buf, long len) {
+  // a block may not end inside a sequence: the last 3 bytes must not start one that is longer
+  const __m128i maxTail = _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+                                        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+  const __m128i zero = _mm_setzero_si128();
+  __m128i prev = zero, incomplete = zero;
+  long i = 0;
+
+  for (; i + 16 <= len; i += 16) {
+    __m128i in = _mm_loadu_si128((const __m128i *)(buf + i));
+    __m128i errors = _mm_movemask_epi8(in) == 0 ? incomplete : blockErrors(in, prev);
+    if (_mm_movemask_epi8(_mm_cmpeq_epi8(errors, zero)) != 0xFFFF)
+      break;
+    incomplete = _mm_subs_epu8(in, maxTail);
+    prev = in;
+  }
+
+  // the sequence running into the block that was not checked is left for the scalar code
+  return sequenceStart(buf, i);
+}
+#endif
+
+long utf8ValidPrefix(const uint8_t *buf, long len) {
+#ifdef HAVE_SSSE3_PATH
+  static int ssse3 = -1; // cached on the first call, racing workers all store the same value
+  int has = __atomic_load_n(&ssse3, __ATOMIC_RELAXED);
+  if (has == -1) {
+    has = __builtin_cpu_supports("ssse3");
+    __atomic_store_n(&ssse3, has, __ATOMIC_RELAXED);
+  }
+  if (has)
+    return ssse3Prefix(buf, len);
+#endif
+  return asciiPrefix(buf, len);
+}
+
+void addError(struct utf8_errors *errors, long offset, int length) {
+  if (errors->count < MAX_REPORTED_ERRORS) {
+    errors->offset[errors->count] = offset;
+    errors->length[errors->count] = length;
+  }
+  errors->count++;
+}
+
+long utf8Validate(const uint8_t *buf, long len, long offset, int last, struct utf8_errors *errors) {
+  long i = 0;
+
+  while (i < len) {
+    i += utf8ValidPrefix(buf + i, len - i);
+    if (i >= len)
+      break;
+
+    int n = utf8Sequence(buf + i, len - i);
+    if (n == 0) { // cut by the end of the block
+      if (!last)
+        return i;
+      n = -(int)(len - i);
+    }
+    if (n < 0) {
+      addError(errors, offset + i, -n);
+      n = -n;
+    }
+    i += n;
+  }
+  return len;
+}
+
+long utf8Fix(const uint8_t *buf, long len, int last, enum utf8_policy policy, uint8_t *out, long *out_len) {
+  long i = 0, o = 0;
+
+  while (i < len) {
+    long valid = utf8ValidPrefix(buf + i, len - i);
+    memcpy(out + o, buf + i, valid);
+    i += valid;
+    o += valid;
+    if (i >= len)
+      break;
+
+    int n = utf8Sequence(buf + i, len - i);
+    if (n > 0) {
+      memcpy(out + o, buf + i, n);
+      o += n;
+      i += n;
+      continue;
+    }
+    if (n == 0) { // cut by the end of the block
+      if (!last)
+        break;
+      n = -(int)(len - i);
+    }
+    if (policy == UTF8_REPLACE) {
+      out[o++] = 0xEF;
+      out[o++] = 0xBF;
+      out[o++] = 0xBD;
+    }
+    i -= n;
+  }
+  *out_len = o;
+  return i;
+}
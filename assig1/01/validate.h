@@ -0,0 +1,84 @@
+#ifndef VALIDATE_H
+#define VALIDATE_H
+
+#include <stdint.h>
+
+#define MAX_REPORTED_ERRORS 16 // bad sequences whose offsets are kept, the rest are only counted
+#define REPLACEMENT_SIZE 3     // U+FFFD is EF BF BD
+
+/**
+ * @brief What to do with the invalid UTF-8 sequences of an input.
+ */
+enum utf8_policy {
+  UTF8_REJECT,  // the input is not counted
+  UTF8_REPLACE, // each bad sequence reads as U+FFFD (a delimiter)
+  UTF8_SKIP     // bad sequences are dropped, the bytes around them are joined
+};
+
+/**
+ * @brief The bad sequences found in an input.
+ */
+struct utf8_errors {
+  long count;
+  long offset[MAX_REPORTED_ERRORS]; // byte offset of the first bad sequences
+  int length[MAX_REPORTED_ERRORS];  // their length in bytes
+};
+
+/**
+ * @brief Parses a policy name ("reject", "replace" or "skip").
+ *
+ * @return 0 on success, -1 if the name is unknown.
+ */
+extern int parsePolicy(const char *arg, enum utf8_policy *policy);
+
+/**
+ * @brief Checks the sequence at the start of buf (Unicode maximal subpart rules).
+ *
+ * @param buf The bytes to check.
+ * @param len The bytes available in buf (at least 1).
+ * @return The length of a valid sequence, minus the length of an invalid one,
+ * or 0 if buf ends in the middle of a sequence that is valid so far.
+ */
+extern int utf8Sequence(const uint8_t *buf, long len);
+
+/**
+ * @brief Finds a prefix of buf that is valid UTF-8, 16 bytes at a time (SSSE3 if available).
+ *
+ * @return The length of the prefix, it ends on a sequence boundary and can be
+ * short of the first bad sequence by up to 18 bytes, which are left for utf8Sequence().
+ */
+extern long utf8ValidPrefix(const uint8_t *buf, long len);
+
+/**
+ * @brief Validates a block of an input and records its bad sequences.
+ *
+ * @param buf The block.
+ * @param len Its length in bytes.
+ * @param offset The offset of the block in the input.
+ * @param last !0 if the input ends with the block.
+ * @param errors Where the bad sequences are added.
+ * @return The bytes checked, a sequence cut by the end of a block that is not the
+ * last is left unchecked and should start the next block.
+ */
+extern long utf8Validate(const uint8_t *buf, long len, long offset, int last, struct utf8_errors *errors);
+
+/**
+ * @brief Records a bad sequence, only the first MAX_REPORTED_ERRORS keep their offset.
+ */
+extern void addError(struct utf8_errors *errors, long offset, int length);
+
+/**
+ * @brief Copies a block of an input replacing or dropping its bad sequences.
+ *
+ * @param buf The block.
+ * @param len Its length in bytes.
+ * @param last !0 if the block ends the input.
+ * @param out At least len + 2 * (bad sequences of the block) bytes, a bad sequence of 1 to 3
+ * bytes is replaced by the 3 bytes of U+FFFD.
+ * @param out_len The length of the copy.
+ * @return The bytes copied, as utf8Validate a sequence cut by the end of a block that is
+ * not the last is left and should start the next block.
+ */
+extern long utf8Fix(const uint8_t *buf, long len, int last, enum utf8_policy policy, uint8_t *out, long *out_len);
+
+#endif
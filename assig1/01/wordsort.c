@@ -0,0 +1,115 @@
+#include "wordsort.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INSERTION_CUTOFF 32 // buckets smaller than this are insertion sorted
+#define MAX_RADIX_DEPTH 64  // words that still share this many bytes are sorted by comparisons, the recursion stays shallow
+
+uint64_t wordPrefix(const char *str, int len) {
+  uint64_t prefix = 0;
+  for (int i = 0; i < PREFIX_SIZE; i++) {
+    prefix = prefix << 8 | (i < len ? (uint8_t)str[i] : 0);
+  }
+  return prefix;
+}
+
+void radixCount(const struct word_ref *words, long n, int depth, long count[RADIX]) {
+  memset(count, 0, RADIX * sizeof(long));
+  for (long i = 0; i < n; i++) {
+    count[wordByte(&words[i], depth)]++;
+  }
+}
+
+void radixScatter(const struct word_ref *words, long n, int depth, long next[RADIX], struct word_ref *out) {
+  for (long i = 0; i < n; i++) {
+    out[next[wordByte(&words[i], depth)]++] = words[i];
+  }
+}
+
+/*
+ * compares two words that share their first depth bytes
+ * */
+static inline int compareWords(const struct word_ref *a, const struct word_ref *b, int depth) {
+  if (depth < PREFIX_SIZE && a->prefix != b->prefix)
+    return a->prefix < b->prefix ? -1 : 1;
+  if (a->len <= PREFIX_SIZE || b->len <= PREFIX_SIZE) // equal prefixes, the shorter word is done
+    return a->len - b->len;
+  int from = depth > PREFIX_SIZE ? depth : PREFIX_SIZE;
+  return strcmp(a->str + from, b->str + from);
+}
+
+static void insertionSort(struct word_ref *words, long n, int depth) {
+  for (long i = 1; i < n; i++) {
+    struct word_ref w = words[i];
+    long j = i;
+    while (j > 0 && compareWords(&words[j - 1], &w, depth) > 0) {
+      words[j] = words[j - 1];
+      j--;
+    }
+    words[j] = w;
+  }
+}
+
+// qsort comparator of whole words
+static int compareRefs(const void *a, const void *b) {
+  return compareWords((const struct word_ref *)a, (const struct word_ref *)b, 0);
+}
+
+/*
+ * !0 if the n words, that share their first depth bytes, are all the same word
+ * */
+static int sameWords(const struct word_ref *words, long n, int depth) {
+  for (long i = 1; i < n; i++) {
+    if (compareWords(&words[0], &words[i], depth) != 0)
+      return 0;
+  }
+  return 1;
+}
+
+void msdSort(struct word_ref *words, struct word_ref *tmp, long n, int depth) {
+  long count[RADIX], next[RADIX];
+
+  // a byte that all the words share moves nothing, the loop goes on to the next one
+  for (;; depth++) {
+    if (n < INSERTION_CUTOFF) {
+      insertionSort(words, n, depth);
+      return;
+    }
+    if (depth >= MAX_RADIX_DEPTH) {
+      qsort(words, n, sizeof(struct word_ref), compareRefs);
+      return;
+    }
+    radixCount(words, n, depth, count);
+    int b = wordByte(&words[0], depth);
+    if (count[b] < n)
+      break;
+    if (b == 0 || sameWords(words, n, depth)) // repeated words, e.g. a long token many times
+      return;
+  }
+
+  next[0] = 0;
+  for (int b = 1; b < RADIX; b++) {
+    next[b] = next[b - 1] + count[b - 1];
+  }
+  radixScatter(words, n, depth, next, tmp);
+  memcpy(words, tmp, n * sizeof(struct word_ref));
+
+  // bucket 0 holds the words that end here, they are all equal
+  long start = count[0];
+  for (int b = 1; b < RADIX; b++) {
+    if (count[b] > 1)
+      msdSort(words + start, tmp + start, count[b], depth + 1);
+    start += count[b];
+  }
+}
+
+long dropDuplicates(struct word_ref *words, long n) {
+  long kept = 0;
+  for (long i = 0; i < n; i++) {
+    if (kept > 0 && words[kept - 1].prefix == words[i].prefix && words[kept - 1].len == words[i].len &&
+        (words[i].len <= PREFIX_SIZE || strcmp(words[kept - 1].str, words[i].str) == 0))
+      continue;
+    words[kept++] = words[i];
+  }
+  return kept;
+}
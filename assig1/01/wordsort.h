@@ -0,0 +1,59 @@
+#ifndef WORDSORT_H
+#define WORDSORT_H
+
+#include <stdint.h>
+
+#define PREFIX_SIZE 8 // bytes of a word cached in its reference
+#define RADIX 256
+
+/**
+ * @brief A word to sort: its first PREFIX_SIZE bytes packed big endian (zero padded),
+ * so comparing prefixes compares the words up to there, and the whole word.
+ */
+struct word_ref {
+  uint64_t prefix;
+  const char *str; // NUL terminated, words never contain a 0x00 byte
+  int len;
+};
+
+/**
+ * @brief Packs the first PREFIX_SIZE bytes of a word.
+ */
+extern uint64_t wordPrefix(const char *str, int len);
+
+/**
+ * @brief Gives the byte of a word at a depth, 0 past its end.
+ */
+static inline uint8_t wordByte(const struct word_ref *w, int depth) {
+  if (depth < PREFIX_SIZE)
+    return (uint8_t)(w->prefix >> (8 * (PREFIX_SIZE - 1 - depth)));
+  return depth < w->len ? (uint8_t)w->str[depth] : 0;
+}
+
+/**
+ * @brief Counts the words of words[0, n) in each bucket of the byte at depth.
+ */
+extern void radixCount(const struct word_ref *words, long n, int depth, long count[RADIX]);
+
+/**
+ * @brief Moves the words of words[0, n) to their buckets, next[b] is where the
+ * next word of bucket b goes in out and is advanced.
+ */
+extern void radixScatter(const struct word_ref *words, long n, int depth, long next[RADIX], struct word_ref *out);
+
+/**
+ * @brief Sorts words that share their first depth bytes, MSD radix sort with an insertion sort for small buckets
+ * and a comparison sort for words that share more than a few dozen bytes.
+ *
+ * @param tmp n references of scratch space.
+ */
+extern void msdSort(struct word_ref *words, struct word_ref *tmp, long n, int depth);
+
+/**
+ * @brief Drops the repeated words of a sorted array.
+ *
+ * @return The number of distinct words, they are moved to the front.
+ */
+extern long dropDuplicates(struct word_ref *words, long n);
+
+#endif
@@ -3,6 +3,8 @@
 #include <stdlib.h>
 #include <time.h>
 
+#include "../typed_sort.h"
+
 int main(int argc, char *argv[]) {
 
   if (argc != 3) {
@@ -12,7 +14,7 @@ int main(int argc, char *argv[]) {
 
   uint64_t numberLen = atoi(argv[2]);
 
-  uint i, j, k, err;
+  uint i, err;
   FILE *fd = fopen(argv[1], "rb");
 
   err = fseek(fd, 0, SEEK_END);
@@ -44,50 +46,15 @@ int main(int argc, char *argv[]) {
 
   clock_t t = clock();
 
-  // unroll of the first cycle
-  uint32_t temp;
-  for (i = 0; i < arrayLen; i += 2) {
-    if (numbers[i] > numbers[i + 1]) {
-      ntemp[i] = numbers[i + 1];
-      ntemp[i + 1] = temp;
-    } else {
-      ntemp[i] = numbers[i];
-      ntemp[i + 1] = numbers[i + 1];
-    }
-  }
-  ntemp_ptr = numbers;
-  numbers = ntemp;
-  ntemp = ntemp_ptr;
-
-  // second pass
-  uint32_t l, r, step, halfStep;
-  for (step = 4; step <= arrayLen; step <<= 1) {
+  // runs of 1 number are merged in pairs, then runs of 2, ... (any amount of numbers)
+  uint64_t step, halfStep, l, r, end;
+  for (step = 2; step / 2 < arrayLen; step <<= 1) {
     halfStep = step >> 1;
 
-    for (i = 0; i < arrayLen; i += step) {
-      k = i;
-      l = i;
-      r = i + halfStep;
-      while (l < i + halfStep && r < i + step) {
-        if (numbers[l] < numbers[r]) {
-          ntemp[k] = numbers[l];
-          l++;
-        } else {
-          ntemp[k] = numbers[r];
-          r++;
-        }
-        k++;
-      }
-      while (l < i + halfStep) {
-        ntemp[k] = numbers[l];
-        l++;
-        k++;
-      }
-      while (r < i + step) {
-        ntemp[k] = numbers[r];
-        r++;
-        k++;
-      }
+    for (l = 0; l < arrayLen; l += step) {
+      r = l + halfStep < arrayLen ? l + halfStep : arrayLen;
+      end = l + step < arrayLen ? l + step : arrayLen;
+      mergeRuns_u32_asc(numbers + l, r - l, numbers + r, end - r, ntemp + l);
     }
     ntemp_ptr = numbers;
     numbers = ntemp;
@@ -0,0 +1,283 @@
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "typed_sort.h"
+
+/*
+ * External sort of the .bin datasets (a 32 bit count followed by the keys) larger than the memory.
+ * The input is cut in runs that fill the memory budget, each run is sorted in memory and spilled to
+ * a temporary file, then the runs are merged with a loser tree, at most fan-in runs at a time, each
+ * one read through its share of the budget. Temporary files go to $TMPDIR (default /tmp).
+ * */
+
+#define MIN_STREAM_BYTES (1 << 20) // smallest buffer of a run in a merge, sets the fan-in
+
+struct run_stream {
+  int fd;
+  off_t offset; // of the next keys of the run in the file
+  long left;    // keys of the run still in the file
+  void *buf;
+  long cap, pos, len; // keys of the buffer, next key and keys read
+  int size;           // bytes of a key
+  int alive;          // 0 once every key was taken
+};
+
+struct out_stream {
+  int fd;
+  void *buf;
+  long cap, len;
+  int size;
+};
+
+static double get_delta_time(void) {
+  static struct timespec t0, t1;
+  t0 = t1;
+  if (clock_gettime(CLOCK_MONOTONIC, &t1) != 0) {
+    perror("clock_gettime");
+    exit(1);
+  }
+  return (double)(t1.tv_sec - t0.tv_sec) + 1.0e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+}
+
+static void readFully(int fd, void *buf, size_t bytes, off_t offset) {
+  while (bytes > 0) {
+    ssize_t r = pread(fd, buf, bytes, offset);
+    if (r <= 0) {
+      perror("Error reading file");
+      exit(3);
+    }
+    buf = (char *)buf + r;
+    bytes -= r;
+    offset += r;
+  }
+}
+
+static void writeFully(int fd, const void *buf, size_t bytes) {
+  while (bytes > 0) {
+    ssize_t w = write(fd, buf, bytes);
+    if (w <= 0) {
+      perror("Error writing file");
+      exit(3);
+    }
+    buf = (const char *)buf + w;
+    bytes -= w;
+  }
+}
+
+static void refillRun(struct run_stream *r) {
+  long n = r->left < r->cap ? r->left : r->cap;
+  readFully(r->fd, r->buf, n * r->size, r->offset);
+  r->offset += n * r->size;
+  r->left -= n;
+  r->pos = 0;
+  r->len = n;
+  r->alive = n > 0;
+}
+
+static void flushOut(struct out_stream *out) {
+  writeFully(out->fd, out->buf, out->len * out->size);
+  out->len = 0;
+}
+
+#define EXT_KEY int32_t
+#define EXT_NAME(fn) fn##_i32
+#include "typed_external_body.h"
+#undef EXT_KEY
+#undef EXT_NAME
+#define EXT_KEY uint32_t
+#define EXT_NAME(fn) fn##_u32
+#include "typed_external_body.h"
+#undef EXT_KEY
+#undef EXT_NAME
+#define EXT_KEY int64_t
+#define EXT_NAME(fn) fn##_i64
+#include "typed_external_body.h"
+#undef EXT_KEY
+#undef EXT_NAME
+#define EXT_KEY uint64_t
+#define EXT_NAME(fn) fn##_u64
+#include "typed_external_body.h"
+#undef EXT_KEY
+#undef EXT_NAME
+#define EXT_KEY float
+#define EXT_NAME(fn) fn##_f32
+#include "typed_external_body.h"
+#undef EXT_KEY
+#undef EXT_NAME
+#define EXT_KEY double
+#define EXT_NAME(fn) fn##_f64
+#include "typed_external_body.h"
+#undef EXT_KEY
+#undef EXT_NAME
+
+/**
+ * @brief Merges k runs of the file fd, run i from key runStart[i] to runStart[i + 1], into out_fd.
+ *
+ * The budget is split evenly between the buffers of the runs and the output buffer.
+ */
+static void mergeRunGroup(int fd, const long *runStart, int k, int out_fd, long budget, enum sort_key key) {
+  int size = sortKeySize(key);
+  long keys = budget / (k + 1) / size;
+  struct run_stream *runs = (struct run_stream *)malloc(k * sizeof(struct run_stream));
+  struct out_stream out = {out_fd, malloc(keys * size), keys, 0, size};
+
+  for (int i = 0; i < k; i++) {
+    runs[i].fd = fd;
+    runs[i].offset = (off_t)runStart[i] * size;
+    runs[i].left = runStart[i + 1] - runStart[i];
+    runs[i].buf = malloc(keys * size);
+    runs[i].cap = keys;
+    runs[i].size = size;
+    refillRun(&runs[i]);
+  }
+
+  switch (key) {
+#define EXT_MERGE(suffix, type)               \
+  case SORT_KEY_##suffix:                     \
+    mergeRunFiles_##suffix(runs, k, &out);    \
+    break;
+    SORT_KEYS(EXT_MERGE)
+#undef EXT_MERGE
+  default:
+    break;
+  }
+
+  for (int i = 0; i < k; i++) {
+    free(runs[i].buf);
+  }
+  free(runs);
+  free(out.buf);
+}
+
+/**
+ * @brief Opens an unnamed temporary file in $TMPDIR, it is removed when closed.
+ */
+static int openTemp(void) {
+  const char *dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp";
+  char path[4096];
+
+  snprintf(path, sizeof(path), "%s/external_sortXXXXXX", dir);
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    perror("Error creating temporary file");
+    exit(3);
+  }
+  unlink(path);
+  return fd;
+}
+
+/**
+ * @brief !0 if the n keys of a file (after its count) are in ascending order, read budget bytes at a time.
+ */
+static int fileIsSorted(int fd, long n, long budget, enum sort_key key) {
+  int size = sortKeySize(key);
+  long keys = budget / size - 1;
+  char *buf = (char *)malloc((keys + 1) * size);
+
+  for (long i = 0; i < n; i += keys) {
+    long m = n - i < keys ? n - i : keys;
+    readFully(fd, buf + size, m * size, 4 + (off_t)i * size);
+    // the last key of the previous block goes first, the blocks are checked across their boundary too
+    if (!isSortedKeys(i == 0 ? buf + size : buf, i == 0 ? m : m + 1, key, SORT_ASC)) {
+      free(buf);
+      return 0;
+    }
+    memcpy(buf, buf + m * size, size);
+  }
+  free(buf);
+  return 1;
+}
+
+int main(int argc, char *argv[]) {
+  enum sort_key key = SORT_KEY_u32;
+
+  if ((argc != 4 && argc != 5) || atol(argv[3]) <= 0 || (argc == 5 && parseSortKey(argv[4], &key) != 0)) {
+    printf("Usage: %s <input_file.bin> <output_file.bin> <memory MiB> [i32|u32|i64|u64|f32|f64]\n", argv[0]);
+    return 1;
+  }
+  long budget = atol(argv[3]) << 20;
+  int size = sortKeySize(key);
+
+  int in_fd = open(argv[1], O_RDONLY);
+  if (in_fd < 0) {
+    printf("Error opening file %s\n", argv[1]);
+    return 3;
+  }
+  int out_fd = open(argv[2], O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (out_fd < 0) {
+    printf("Error opening file %s\n", argv[2]);
+    return 3;
+  }
+
+  uint32_t n;
+  readFully(in_fd, &n, 4, 0);
+  printf("File: %s\n", argv[1]);
+  printf("Numbers Count: %u\n", n);
+  printf("Memory: %ld MiB\n", budget >> 20);
+
+  get_delta_time();
+
+  // Runs: the sort needs the keys and as much scratch space
+  long runKeys = budget / (2 * size);
+  long numRuns = (n + runKeys - 1) / runKeys;
+  long *runStart = (long *)malloc((numRuns + 1) * sizeof(long));
+  char *buf = (char *)malloc(runKeys * size);
+  char *tmp = (char *)malloc(runKeys * size);
+  int temp_fd = openTemp();
+
+  for (long r = 0; r < numRuns; r++) {
+    long m = n - r * runKeys < runKeys ? n - r * runKeys : runKeys;
+    runStart[r] = r * runKeys;
+    readFully(in_fd, buf, m * size, 4 + (off_t)r * runKeys * size);
+    mergeSortKeys(buf, m, key, SORT_ASC, tmp);
+    writeFully(temp_fd, buf, m * size);
+  }
+  runStart[numRuns] = n;
+  free(buf);
+  free(tmp);
+  printf("Runs: %ld\n", numRuns);
+
+  // Merge passes until one merge of at most fanIn runs is left, each pass writes the next temporary file
+  long fanIn = budget / MIN_STREAM_BYTES - 1;
+  if (fanIn < 2)
+    fanIn = 2;
+  while (numRuns > fanIn) {
+    int next_fd = openTemp();
+    long merged = 0;
+
+    for (long r = 0; r < numRuns; r += fanIn) {
+      long k = numRuns - r < fanIn ? numRuns - r : fanIn;
+      mergeRunGroup(temp_fd, runStart + r, k, next_fd, budget, key);
+      runStart[merged++] = runStart[r];
+    }
+    runStart[merged] = n;
+    numRuns = merged;
+    close(temp_fd);
+    temp_fd = next_fd;
+    printf("Merge pass: %ld runs\n", numRuns);
+  }
+
+  writeFully(out_fd, &n, 4);
+  if (numRuns > 0) {
+    mergeRunGroup(temp_fd, runStart, numRuns, out_fd, budget, key);
+  }
+  close(temp_fd);
+  printf("Time to external sort: %fs\n", get_delta_time());
+
+  // verify correcteness
+  if (!fileIsSorted(out_fd, n, budget, key)) {
+    printf("Not Sorted\n");
+  }
+
+  free(runStart);
+  close(in_fd);
+  close(out_fd);
+
+  return 0;
+}
@@ -0,0 +1,246 @@
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "typed_sort.h"
+
+/*
+ * Parallel LSD radix sort of the .bin datasets (a 32 bit count followed by the keys).
+ * Every pass each thread counts the digits of its slice, the counts of all threads give
+ * each thread where its keys of every digit go, and the slice is scattered there.
+ * */
+
+#define RADIX_BITS 8 // 256 digits, 4 passes for 32 bit keys and 8 for 64 bit keys
+#define RADIX_WC (64 / sizeof(RADIX_KEY))
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/**
+ * @brief Writes the 64 bytes of line to dst (both aligned to 64), around the cache when the CPU can.
+ */
+static inline void radixStreamLine(void *dst, const void *line) {
+#ifdef __SSE2__
+  for (int i = 0; i < 4; i++) {
+    _mm_stream_si128((__m128i *)dst + i, _mm_load_si128((const __m128i *)line + i));
+  }
+#else
+  memcpy(dst, line, 64);
+#endif
+}
+
+// the streamed lines are seen by the other threads after it
+static inline void radixStreamFence(void) {
+#ifdef __SSE2__
+  _mm_sfence();
+#endif
+}
+
+#define RADIX_KEY uint32_t
+#define RADIX_NAME(fn) fn##_u32
+#include "typed_radix_body.h"
+#undef RADIX_KEY
+#undef RADIX_NAME
+
+#define RADIX_KEY uint64_t
+#define RADIX_NAME(fn) fn##_u64
+#include "typed_radix_body.h"
+#undef RADIX_KEY
+#undef RADIX_NAME
+
+static double get_delta_time(void) {
+  static struct timespec t0, t1;
+  t0 = t1;
+  if (clock_gettime(CLOCK_MONOTONIC, &t1) != 0) {
+    perror("clock_gettime");
+    exit(1);
+  }
+  return (double)(t1.tv_sec - t0.tv_sec) + 1.0e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
+}
+
+int readCmdArgs(int argc, char **argv, FILE **fd, int *thr_count, enum sort_key *key) {
+  if (argc != 3 && argc != 4) {
+    printf("Usage: %s <input_file.bin> <thread count> [i32|u32|i64|u64|f32|f64]\n", argv[0]);
+    return 1; // Error 1 - invalid count of arguments
+  }
+
+  *thr_count = atoi(argv[2]);
+  if (*thr_count <= 0) {
+    printf("Invalid integer input\n");
+    return 2; // Error 2 - invalid thread count
+  }
+
+  *key = SORT_KEY_u32;
+  if (argc == 4 && parseSortKey(argv[3], key) != 0) {
+    printf("Invalid key type %s\n", argv[3]);
+    return 2;
+  }
+
+  *fd = fopen(argv[1], "r");
+  if (*fd == NULL) {
+    printf("Error opening file %s\n", argv[1]);
+    return 3; // Error 3 - file opening failure
+  }
+
+  return 0;
+}
+
+struct g_worker_st {
+  long n;
+  int thr_c;
+  enum sort_key key;
+  void *buf[2]; // the passes scatter from one buffer to the other
+  long (*hist)[2][1 << RADIX_BITS]; // digit counts of each thread, by pass parity
+  pthread_barrier_t barrier;
+};
+struct worker_st {
+  int id;
+  struct g_worker_st *worker_shm;
+};
+
+/**
+ * @brief Where the keys of each digit of thread id go: the keys of the smaller digits of
+ * all threads, then the keys of the digit of the threads before it.
+ *
+ * @return !0 if a digit holds all the keys, so the pass would leave them in place.
+ */
+static int radixOffsets(struct g_worker_st *shm, int id, int parity, long *offset) {
+  long start = 0;
+  int single = 0;
+
+  for (int d = 0; d < 1 << RADIX_BITS; d++) {
+    long total = 0;
+    offset[d] = start;
+    for (int t = 0; t < shm->thr_c; t++) {
+      if (t < id)
+        offset[d] += shm->hist[t][parity][d];
+      total += shm->hist[t][parity][d];
+    }
+    single |= total == shm->n;
+    start += total;
+  }
+  return single;
+}
+
+void *worker(void *args) {
+  struct worker_st *st = (struct worker_st *)args;
+  struct g_worker_st *shm = st->worker_shm;
+  int size = sortKeySize(shm->key);
+  long lo = shm->n * st->id / shm->thr_c, hi = shm->n * (st->id + 1) / shm->thr_c;
+  long offset[1 << RADIX_BITS];
+  int cur = 0;
+
+  if (size == 4) {
+    radixMap_u32((uint32_t *)shm->buf[0] + lo, hi - lo, shm->key, 0);
+  } else {
+    radixMap_u64((uint64_t *)shm->buf[0] + lo, hi - lo, shm->key, 0);
+  }
+
+  for (int pass = 0; pass < size * 8 / RADIX_BITS; pass++) {
+    int shift = pass * RADIX_BITS, parity = pass % 2;
+
+    if (size == 4) {
+      radixHistogram_u32((uint32_t *)shm->buf[cur] + lo, hi - lo, shift, shm->hist[st->id][parity]);
+    } else {
+      radixHistogram_u64((uint64_t *)shm->buf[cur] + lo, hi - lo, shift, shm->hist[st->id][parity]);
+    }
+    pthread_barrier_wait(&shm->barrier);
+
+    // the counts of this pass are read until the barrier of the next one, the next pass counts in the other half
+    if (radixOffsets(shm, st->id, parity, offset))
+      continue;
+    if (size == 4) {
+      radixScatter_u32((uint32_t *)shm->buf[cur] + lo, hi - lo, shift, offset, (uint32_t *)shm->buf[1 - cur]);
+    } else {
+      radixScatter_u64((uint64_t *)shm->buf[cur] + lo, hi - lo, shift, offset, (uint64_t *)shm->buf[1 - cur]);
+    }
+    cur = 1 - cur;
+    pthread_barrier_wait(&shm->barrier);
+  }
+
+  if (cur != 0) { // an odd number of passes was skipped
+    memcpy((char *)shm->buf[0] + lo * size, (char *)shm->buf[1] + lo * size, (hi - lo) * size);
+  }
+  if (size == 4) {
+    radixMap_u32((uint32_t *)shm->buf[0] + lo, hi - lo, shm->key, 1);
+  } else {
+    radixMap_u64((uint64_t *)shm->buf[0] + lo, hi - lo, shm->key, 1);
+  }
+
+  return NULL;
+}
+
+/**
+ * @brief Sorts n keys in ascending order with thr_c threads.
+ */
+void radix(int thr_c, long n, void *buf, enum sort_key key) {
+  pthread_t thr[thr_c];
+  struct worker_st worker_args[thr_c];
+  struct g_worker_st worker_shm = {n, thr_c, key, {buf, NULL}, NULL};
+  int size = sortKeySize(key);
+
+  worker_shm.buf[1] = aligned_alloc(64, (n * size + 63) / 64 * 64 + 64);
+  worker_shm.hist = malloc(thr_c * sizeof(*worker_shm.hist));
+  pthread_barrier_init(&worker_shm.barrier, NULL, thr_c);
+
+  for (int i = 0; i < thr_c; i++) {
+    worker_args[i].id = i;
+    worker_args[i].worker_shm = &worker_shm;
+    pthread_create(&thr[i], NULL, worker, &worker_args[i]);
+  }
+
+  for (int i = 0; i < thr_c; i++) {
+    pthread_join(thr[i], NULL);
+  }
+
+  pthread_barrier_destroy(&worker_shm.barrier);
+  free(worker_shm.hist);
+  free(worker_shm.buf[1]);
+}
+
+int main(int argc, char *argv[]) {
+  int err;
+
+  FILE *fd;
+  int thr_count;
+  enum sort_key key;
+  err = readCmdArgs(argc, argv, &fd, &thr_count, &key);
+  if (err) {
+    return err;
+  }
+  printf("Threads: %d\n", thr_count);
+  printf("File: %s\n", argv[1]);
+
+  uint32_t n;
+  int size = sortKeySize(key);
+  if (fread(&n, 4, 1, fd) != 1) {
+    printf("Error reading file %s\n", argv[1]);
+    return 3;
+  }
+  printf("Numbers Count: %d\n", n);
+
+  // load all numbers to memory, the scatter writes whole cache lines of it
+  void *buf = aligned_alloc(64, ((long)n * size + 63) / 64 * 64 + 64);
+  if (fread(buf, size, n, fd) != n) {
+    printf("Error reading file %s\n", argv[1]);
+    return 3;
+  }
+
+  get_delta_time();
+  radix(thr_count, n, buf, key);
+  printf("Time to radix sort: %fs\n", get_delta_time());
+
+  // verify correcteness
+  if (!isSortedKeys(buf, n, key, SORT_ASC)) {
+    printf("Not Sorted\n");
+  }
+
+  fclose(fd);
+  free(buf);
+
+  return 0;
+}
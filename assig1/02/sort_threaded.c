@@ -1,10 +1,17 @@
 #include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
 
+#include "typed_sort.h"
+
 #define MAX_FILENAME_LENGTH 256
 #define MAX_THREADS 100
+#define GRAIN_SIZE 16384 // keys below which a task sorts, merges or compares without forking
+#define DEQUE_SIZE 1024  // tasks pending in a deque, the recursion only keeps a few per level
 
 pthread_mutex_t print_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -22,13 +29,16 @@ typedef struct {
   int num_threads;
   int *sorted_sequence;
   int sequence_length;
+  int tasks; // sort with fork-join tasks instead of a piece per thread
 } DistributorParams;
 
-// Bitonic merge
+// Bitonic merge, cnt keys of any count: a reversed run followed by a run
 void bitonic_merge(int *arr, int low, int cnt, int dir) {
   if (cnt > 1) {
-    int k = cnt / 2; // Divide in half the array
-    for (int i = low; i < low + k; i++) {
+    int k = 1; // greatest power of 2 below cnt
+    while (k * 2 < cnt)
+      k *= 2;
+    for (int i = low; i < low + cnt - k; i++) {
       if ((arr[i] < arr[i + k]) == dir) { // Decreasing order
         int temp = arr[i];
         arr[i] = arr[i + k];
@@ -36,20 +46,227 @@ void bitonic_merge(int *arr, int low, int cnt, int dir) {
       }
     }
     bitonic_merge(arr, low, k, dir);
-    bitonic_merge(arr, low + k, k, dir);
+    bitonic_merge(arr, low + k, cnt - k, dir);
   }
 }
 
-// Bitonic sort
+// Bitonic sort, cnt keys of any count
 void bitonic_sort(int *arr, int low, int cnt, int dir) {
   if (cnt > 1) {
     int k = cnt / 2;
-    bitonic_sort(arr, low, k, 1);
-    bitonic_sort(arr, low + k, k, 0);
+    bitonic_sort(arr, low, k, !dir);
+    bitonic_sort(arr, low + k, cnt - k, dir);
     bitonic_merge(arr, low, cnt, dir);
   }
 }
 
+// fork-join task, forked by pushing it to the deque of the thread and joined by waiting for done
+typedef struct Task {
+  void (*run)(struct Task *);
+  int *arr;
+  int low;
+  int cnt;
+  int dir;
+  int dist; // of the keys compared by compare_task
+  atomic_int done;
+} Task;
+
+// Chase-Lev deque: the owner pushes and takes at the bottom, the other threads steal at the top
+typedef struct {
+  atomic_long top;
+  atomic_long bottom;
+  _Atomic(Task *) tasks[DEQUE_SIZE];
+} Deque;
+
+Deque deques[MAX_THREADS];
+int pool_threads;
+atomic_int pool_done;
+static __thread int pool_id;
+static __thread unsigned int pool_seed;
+
+// Pushes a task, 0 if the deque is full
+static int deque_push(Deque *d, Task *task) {
+  long b = atomic_load_explicit(&d->bottom, memory_order_relaxed);
+  if (b - atomic_load_explicit(&d->top, memory_order_acquire) >= DEQUE_SIZE) { // the top only grows, never overwrites
+    return 0;
+  }
+  // release: the fields of the task are seen by the thread that loads it
+  atomic_store_explicit(&d->tasks[b % DEQUE_SIZE], task, memory_order_release);
+  atomic_store_explicit(&d->bottom, b + 1, memory_order_release);
+  return 1;
+}
+
+static Task *deque_take(Deque *d) {
+  long b = atomic_load_explicit(&d->bottom, memory_order_relaxed) - 1;
+  atomic_store_explicit(&d->bottom, b, memory_order_relaxed);
+  atomic_thread_fence(memory_order_seq_cst);
+  long t = atomic_load_explicit(&d->top, memory_order_relaxed);
+  Task *task = NULL;
+
+  if (t <= b) {
+    task = atomic_load_explicit(&d->tasks[b % DEQUE_SIZE], memory_order_relaxed);
+    if (t == b) { // the last task, a thief may be taking it too
+      if (!atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+        task = NULL;
+      }
+      atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+    }
+  } else {
+    atomic_store_explicit(&d->bottom, b + 1, memory_order_relaxed);
+  }
+  return task;
+}
+
+static Task *deque_steal(Deque *d) {
+  long t = atomic_load_explicit(&d->top, memory_order_acquire);
+  atomic_thread_fence(memory_order_seq_cst);
+  long b = atomic_load_explicit(&d->bottom, memory_order_acquire);
+
+  if (t < b) {
+    Task *task = atomic_load_explicit(&d->tasks[t % DEQUE_SIZE], memory_order_acquire);
+    if (atomic_compare_exchange_strong_explicit(&d->top, &t, t + 1, memory_order_seq_cst, memory_order_relaxed)) {
+      return task;
+    }
+  }
+  return NULL;
+}
+
+static void run_task(Task *task) {
+  task->run(task);
+  atomic_store_explicit(&task->done, 1, memory_order_release);
+}
+
+// Runs one task of the own deque or stolen from a random thread, 0 if none was found
+static int run_pending_task(void) {
+  Task *task = deque_take(&deques[pool_id]);
+
+  for (int i = 0; task == NULL && i < pool_threads; i++) {
+    int victim = rand_r(&pool_seed) % pool_threads;
+    if (victim != pool_id) {
+      task = deque_steal(&deques[victim]);
+    }
+  }
+  if (task == NULL) {
+    return 0;
+  }
+  run_task(task);
+  return 1;
+}
+
+static void fork_task(Task *task, void (*run)(Task *), int *arr, int low, int cnt, int dir, int dist) {
+  task->run = run;
+  task->arr = arr;
+  task->low = low;
+  task->cnt = cnt;
+  task->dir = dir;
+  task->dist = dist;
+  atomic_init(&task->done, 0);
+  if (!deque_push(&deques[pool_id], task)) {
+    run_task(task); // no room to fork it, its join returns at once
+  }
+}
+
+// Waits for a forked task, running other tasks meanwhile (the task itself if nobody stole it)
+static void join_task(Task *task) {
+  while (!atomic_load_explicit(&task->done, memory_order_acquire)) {
+    if (!run_pending_task()) {
+      sched_yield();
+    }
+  }
+}
+
+// Compares the keys [low, low + cnt) with the ones k after them, halves forked down to the grain
+static void compare_task(Task *task) {
+  int k = task->dist, dir = task->dir;
+  if (task->cnt <= GRAIN_SIZE) {
+    for (int i = task->low; i < task->low + task->cnt; i++) {
+      if ((task->arr[i] < task->arr[i + k]) == dir) {
+        int temp = task->arr[i];
+        task->arr[i] = task->arr[i + k];
+        task->arr[i + k] = temp;
+      }
+    }
+    return;
+  }
+  Task left, right = {compare_task, task->arr, task->low + task->cnt / 2, task->cnt - task->cnt / 2, task->dir, k};
+  fork_task(&left, compare_task, task->arr, task->low, task->cnt / 2, task->dir, k);
+  compare_task(&right);
+  join_task(&left);
+}
+
+// Bitonic merge as tasks: the compares, then both halves
+static void bitonic_merge_task(Task *task) {
+  int *arr = task->arr, low = task->low, cnt = task->cnt, dir = task->dir;
+  if (cnt <= GRAIN_SIZE) {
+    bitonic_merge(arr, low, cnt, dir);
+    return;
+  }
+  int k = 1; // greatest power of 2 below cnt
+  while (k * 2 < cnt)
+    k *= 2;
+  Task compares = {compare_task, arr, low, cnt - k, dir, k};
+  compare_task(&compares);
+
+  Task left, right = {bitonic_merge_task, arr, low + k, cnt - k, dir};
+  fork_task(&left, bitonic_merge_task, arr, low, k, dir, 0);
+  bitonic_merge_task(&right);
+  join_task(&left);
+}
+
+// Bitonic sort as tasks: both halves, then the merge
+static void bitonic_sort_task(Task *task) {
+  int *arr = task->arr, low = task->low, cnt = task->cnt, dir = task->dir;
+  if (cnt <= GRAIN_SIZE) {
+    bitonic_sort(arr, low, cnt, dir);
+    return;
+  }
+  int k = cnt / 2;
+  Task left, right = {bitonic_sort_task, arr, low + k, cnt - k, dir};
+  fork_task(&left, bitonic_sort_task, arr, low, k, !dir, 0);
+  bitonic_sort_task(&right);
+  join_task(&left);
+
+  Task merge = {bitonic_merge_task, arr, low, cnt, dir};
+  bitonic_merge_task(&merge);
+}
+
+// Pool thread function: runs the tasks of the others until the sort is done
+void *pool_function(void *args) {
+  pool_id = (int)(long)args;
+  pool_seed = pool_id + 1;
+  while (!atomic_load_explicit(&pool_done, memory_order_acquire)) {
+    if (!run_pending_task()) {
+      sched_yield();
+    }
+  }
+  return NULL;
+}
+
+// Sorts the sequence with fork-join tasks, idle threads steal the tasks forked by the busy ones
+static void task_sort(int *arr, int cnt, int num_threads) {
+  pthread_t threads[num_threads];
+
+  pool_threads = num_threads;
+  atomic_store(&pool_done, 0);
+  for (int i = 0; i < num_threads; i++) {
+    atomic_init(&deques[i].top, 0);
+    atomic_init(&deques[i].bottom, 0);
+  }
+  for (int i = 1; i < num_threads; i++) {
+    pthread_create(&threads[i], NULL, pool_function, (void *)(long)i);
+  }
+
+  pool_id = 0; // the calling thread runs the root task
+  pool_seed = 1;
+  Task root = {bitonic_sort_task, arr, 0, cnt, 1}; // Decreasing order
+  run_task(&root);
+
+  atomic_store_explicit(&pool_done, 1, memory_order_release);
+  for (int i = 1; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+}
+
 // Worker thread function
 void *worker_function(void *args) {
   WorkerParams *params = (WorkerParams *)args;
@@ -63,6 +280,95 @@ void *worker_function(void *args) {
   return NULL;
 }
 
+// merge threads, the sorted pieces are merged in pairs, log2(pieces) rounds
+typedef struct {
+  int num_threads;
+  int num_runs;
+  int *run_start; // num_runs + 1 offsets of the sorted pieces
+  int *buf[2];    // the rounds merge from one buffer into the other
+  pthread_barrier_t barrier;
+} MergeShared;
+
+typedef struct {
+  int id;
+  MergeShared *shared;
+} MergeParams;
+
+/**
+ *  \brief Co-rank of k in the decreasing merge of a and b (ties from a first).
+ *
+ *  \return how many of the first k keys of the merge come from a, the rest come from b
+ */
+static int co_rank(int k, const int *a, int na, const int *b, int nb) {
+  int lo = k > nb ? k - nb : 0;
+  int hi = k < na ? k : na;
+
+  while (lo < hi) {
+    int i = lo + (hi - lo) / 2, j = k - i;
+    if (j > 0 && i < na && b[j - 1] <= a[i]) { // a[i] goes before b[j - 1], more keys of a
+      lo = i + 1;
+    } else if (i > 0 && j < nb && b[j] > a[i - 1]) { // b[j] goes before a[i - 1], less keys of a
+      hi = i - 1;
+    } else {
+      return i;
+    }
+  }
+  return lo;
+}
+
+// Merge thread function: in each round the output of every pair of runs is split evenly between all threads
+void *merge_function(void *args) {
+  MergeParams *params = (MergeParams *)args;
+  MergeShared *shared = params->shared;
+  int n = shared->run_start[shared->num_runs];
+  int lo = (long)n * params->id / shared->num_threads; // output keys of this thread
+  int hi = (long)n * (params->id + 1) / shared->num_threads;
+
+  for (int w = 1, round = 0; w < shared->num_runs; w *= 2, round++) {
+    int *src = shared->buf[round % 2], *dst = shared->buf[1 - round % 2];
+
+    for (int p = 0; p < shared->num_runs; p += 2 * w) {
+      int s = shared->run_start[p];
+      int m = shared->run_start[p + w < shared->num_runs ? p + w : shared->num_runs];
+      int e = shared->run_start[p + 2 * w < shared->num_runs ? p + 2 * w : shared->num_runs];
+      if (e <= lo || s >= hi)
+        continue;
+
+      int k0 = (lo > s ? lo : s) - s, k1 = (hi < e ? hi : e) - s;
+      int i0 = co_rank(k0, src + s, m - s, src + m, e - m);
+      int i1 = co_rank(k1, src + s, m - s, src + m, e - m);
+      mergeRuns_i32_desc(src + s + i0, i1 - i0, src + m + k0 - i0, (k1 - i1) - (k0 - i0), dst + s + k0);
+    }
+    pthread_barrier_wait(&shared->barrier);
+  }
+
+  return NULL;
+}
+
+// Merges the sorted pieces with all threads, returns the buffer left with the sorted keys
+static int *merge_runs(int *sequence, int *temp, int *run_start, int num_runs, int num_threads) {
+  pthread_t threads[num_threads];
+  MergeParams merge_params[num_threads];
+  MergeShared shared = {num_threads, num_runs, run_start, {sequence, temp}};
+  int rounds = 0;
+
+  for (int w = 1; w < num_runs; w *= 2)
+    rounds++;
+
+  pthread_barrier_init(&shared.barrier, NULL, num_threads);
+  for (int i = 0; i < num_threads; i++) {
+    merge_params[i].id = i;
+    merge_params[i].shared = &shared;
+    pthread_create(&threads[i], NULL, merge_function, (void *)&merge_params[i]);
+  }
+  for (int i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  pthread_barrier_destroy(&shared.barrier);
+
+  return shared.buf[rounds % 2];
+}
+
 // Distributor thread function
 void *distributor_thread(void *args) {
   DistributorParams *params = (DistributorParams *)args;
@@ -90,13 +396,30 @@ void *distributor_thread(void *args) {
     return NULL;
   }
 
+  if (params->tasks) {
+    // one task sorts the whole sequence, the threads share its subtasks
+    if (fread(params->sorted_sequence, sizeof(int), num_integers, file) != num_integers) {
+      printf("Error: Failed to read integers from file %s\n", params->filename);
+      fclose(file);
+      free(params->sorted_sequence);
+      params->sorted_sequence = NULL;
+      return NULL;
+    }
+    fclose(file);
+    params->sequence_length = num_integers;
+    task_sort(params->sorted_sequence, num_integers, params->num_threads);
+    return NULL;
+  }
+
   pthread_t threads[params->num_threads]; // Create an array to hold thread IDs
+  int run_start[params->num_threads + 1];  // where the piece of each worker starts
 
   WorkerParams *worker_params = malloc(params->num_threads * sizeof(WorkerParams));
   if (worker_params == NULL) {
     printf("Error: Memory allocation failed for worker_params\n");
     fclose(file);
     free(params->sorted_sequence);
+    params->sorted_sequence = NULL;
     return NULL;
   }
 
@@ -109,23 +432,17 @@ void *distributor_thread(void *args) {
 
     fseek(file, sizeof(int) + start_position * sizeof(int), SEEK_SET);
 
-    // Read integers
-    worker_params[i].array = (int *)malloc(thread_integers * sizeof(int));
-    if (worker_params[i].array == NULL) {
-      printf("Error: Memory allocation failed for worker %d\n", i);
-      fclose(file);
-      free(worker_params);
-      free(params->sorted_sequence);
-      return NULL;
-    }
+    // Read integers, each worker sorts its piece in place
+    worker_params[i].array = params->sorted_sequence + start_position;
+    run_start[i] = start_position;
 
     size_t integers = fread(worker_params[i].array, sizeof(int), thread_integers, file);
     if (integers != thread_integers) {
       printf("Error: Failed to read integers for worker %d from file %s\n", i, params->filename);
-      free(worker_params[i].array);
       fclose(file);
       free(worker_params);
       free(params->sorted_sequence);
+      params->sorted_sequence = NULL;
       return NULL;
     }
 
@@ -142,16 +459,23 @@ void *distributor_thread(void *args) {
     pthread_join(threads[i], NULL);
   }
 
-  for (int i = 0; i < params->num_threads; i++) {
-    for (int j = 0; j < worker_params[i].num_elements; j++) {
-      params->sorted_sequence[params->sequence_length++] = worker_params[i].array[j];
-    }
-  }
+  run_start[params->num_threads] = num_integers;
+  params->sequence_length = num_integers;
 
   fclose(file);
 
-  // Perform final bitonic merge on the sorted sequence from the given sequences of each worker
-  bitonic_sort(params->sorted_sequence, 0, params->sequence_length, 1);
+  // Merge the sorted pieces of the workers, every thread writes an equal share of each round
+  int *temp = (int *)malloc(num_integers * sizeof(int));
+  if (temp == NULL) {
+    printf("Error: Memory allocation failed for the merge buffer\n");
+    free(worker_params);
+    free(params->sorted_sequence);
+    params->sorted_sequence = NULL;
+    return NULL;
+  }
+  int *sorted = merge_runs(params->sorted_sequence, temp, run_start, params->num_threads, params->num_threads);
+  free(sorted == temp ? params->sorted_sequence : temp);
+  params->sorted_sequence = sorted;
 
   free(worker_params);
 
@@ -177,7 +501,7 @@ static double get_delta_time(void) {
 
 int main(int argc, char *argv[]) {
   if (argc < 3) {
-    printf("Usage: %s <thread_count> <filename>\n", argv[0]);
+    printf("Usage: %s <thread_count> <filename> [tasks]\n", argv[0]);
     return 1;
   }
 
@@ -197,6 +521,7 @@ int main(int argc, char *argv[]) {
   distributor_params.num_threads = num_threads;
   distributor_params.sorted_sequence = NULL;
   distributor_params.sequence_length = 0;
+  distributor_params.tasks = argc > 3 && strcmp(argv[3], "tasks") == 0;
 
   clock_t start_time = clock(); // start time
 
@@ -1,8 +1,14 @@
+#include <limits.h>
+#include <linux/futex.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <sys/syscall.h>
 #include <time.h>
+#include <unistd.h>
+
+#include "typed_sort.h"
 
 static double get_delta_time(void) {
   static struct timespec t0, t1;
@@ -14,14 +20,7 @@ static double get_delta_time(void) {
   return (double)(t1.tv_sec - t0.tv_sec) + 1.0e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
 }
 
-void caps(uint32_t *a, uint32_t *b) {
-  uint32_t temp;
-  if (*a > *b) {
-    temp = *a;
-    *a = *b;
-    *b = temp;
-  }
-}
+void caps(uint32_t *a, uint32_t *b) { compareAndSwap_u32_asc(a, b); }
 
 int readCmdArgs(int argc, char **argv, FILE **fd, int *thr_count) {
   if (argc != 3) {
@@ -48,89 +47,65 @@ int readCmdArgs(int argc, char **argv, FILE **fd, int *thr_count) {
   return 0;
 }
 
-void merge_sort_asc(uint32_t *buf, uint32_t start, uint32_t size) { // dir(0) -> ascending
-  uint32_t i, k;
-  buf += start;
-  uint32_t *ntemp = (uint32_t *)malloc(size * 4);
-
-  uint32_t l, r, step, halfstep;
-  for (step = 2; step <= size; step <<= 1) {
-    halfstep = step >> 1;
-
-    for (i = 0; i < size; i += step) {
-      k = i;
-      l = i;
-      r = i + halfstep;
-      while (l < i + halfstep && r < i + step) {
-        if (buf[l] < buf[r]) {
-          ntemp[k++] = buf[l++];
-        } else {
-          ntemp[k++] = buf[r++];
-        }
-      }
-      while (l < i + halfstep) {
-        ntemp[k++] = buf[l++];
-      }
-      while (r < i + step) {
-        ntemp[k++] = buf[r++];
-      }
-    }
-    for (i = 0; i < size; i++) {
-      buf[i] = ntemp[i];
-    }
-  }
+// tmp holds the scratch keys of buf, at the same offsets
+void merge_sort_asc(uint32_t *buf, uint32_t *tmp, uint32_t start, uint32_t size) { // dir(0) -> ascending
+  mergeSort_u32_asc(buf + start, size, tmp + start);
+}
+void merge_sort_desc(uint32_t *buf, uint32_t *tmp, uint32_t start, uint32_t size) {
+  mergeSort_u32_desc(buf + start, size, tmp + start);
+}
 
-  free(ntemp);
+/*
+ * Sense reversing barrier: the last thread to arrive flips the sense, the others spin on it for a
+ * while and then sleep on it with a futex, so a short wait never goes through the kernel.
+ * */
+#define BARRIER_SPINS 4096
+
+struct barrier_st {
+  int count;    // threads still to arrive
+  int sense;    // flipped by the last thread, the futex word
+  int sleepers; // threads waiting in the kernel
+  int thr_c;
+};
+struct barrier_st barrier;
+static __thread int barrier_sense; // sense of the current phase of each thread
+
+static void barrier_init(struct barrier_st *b, int thr_c) {
+  b->count = thr_c;
+  b->sense = 0;
+  b->sleepers = 0;
+  b->thr_c = thr_c;
 }
-void merge_sort_desc(uint32_t *buf, uint32_t start, uint32_t size) {
-  uint32_t i, k;
-  buf += start;
-  uint32_t *ntemp = (uint32_t *)malloc(size * sizeof(uint32_t));
-
-  uint32_t l, r, step, halfstep;
-  for (step = 2; step <= size; step <<= 1) {
-    halfstep = step >> 1;
-
-    for (i = 0; i < size; i += step) {
-      k = i;
-      l = i;
-      r = i + halfstep;
-      while (l < i + halfstep && r < i + step) {
-        if (buf[l] > buf[r]) {
-          ntemp[k++] = buf[l++];
-        } else {
-          ntemp[k++] = buf[r++];
-        }
-      }
-      while (l < i + halfstep) {
-        ntemp[k++] = buf[l++];
-      }
-      while (r < i + step) {
-        ntemp[k++] = buf[r++];
-      }
-    }
-    for (i = 0; i < size; i++) {
-      buf[i] = ntemp[i];
-    }
-  }
 
-  free(ntemp);
+static inline void cpu_relax(void) {
+#if defined(__x86_64__) || defined(__i386__)
+  __builtin_ia32_pause();
+#endif
 }
 
-pthread_mutex_t mut;
-pthread_cond_t cond;
-int locked = 0;
-int c = 0;
-void sync(int thr_c) {
-  pthread_mutex_lock(&mut);
-  c++;
-  if (c == thr_c) {
-    pthread_cond_broadcast(&cond);
-    c = 0;
-  } else {
-    pthread_cond_wait(&cond, &mut);
+void barrier_wait(struct barrier_st *b) {
+  int sense = barrier_sense = !barrier_sense;
+
+  if (__atomic_sub_fetch(&b->count, 1, __ATOMIC_ACQ_REL) == 0) {
+    b->count = b->thr_c; // nobody touches it again before the sense flips
+    __atomic_store_n(&b->sense, sense, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&b->sleepers, __ATOMIC_SEQ_CST) > 0) {
+      syscall(SYS_futex, &b->sense, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+    return;
+  }
+
+  for (int i = 0; i < BARRIER_SPINS; i++) {
+    if (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) == sense)
+      return;
+    cpu_relax();
+  }
+  // a flip between the count and the wait makes the futex return at once, the sense is checked again
+  __atomic_add_fetch(&b->sleepers, 1, __ATOMIC_SEQ_CST);
+  while (__atomic_load_n(&b->sense, __ATOMIC_ACQUIRE) != sense) {
+    syscall(SYS_futex, &b->sense, FUTEX_WAIT_PRIVATE, !sense, NULL, NULL, 0);
   }
-  pthread_mutex_unlock(&mut);
+  __atomic_sub_fetch(&b->sleepers, 1, __ATOMIC_SEQ_CST);
 }
 void bitonic_sort(uint32_t *buf, uint32_t size, uint32_t i, uint32_t thr_c) {
   uint32_t k = -1, n, u, m, t;
@@ -173,12 +148,14 @@ void bitonic_sort2(uint32_t *buf, uint32_t N, uint32_t thr_i, uint32_t thr_c) {
 
   // printf("\n");
 
-  sync(thr_c);
+  barrier_wait(&barrier);
 
-  for (uint32_t m = 1; m < k; m++) {
-    uint32_t nL = 1 << m;
+  uint32_t m = 1;
+  for (; m < k; m++) {
     uint32_t v = N >> (m + 1);
     uint32_t vl1 = N >> m;
+    if (i_size % v == 0)
+      break; // the pairs of the thread are whole blocks of 2 * v keys from here on
 
     for (uint32_t c = i_start; c < i_end; c++) {
       uint32_t t = c % v;
@@ -188,15 +165,22 @@ void bitonic_sort2(uint32_t *buf, uint32_t N, uint32_t thr_i, uint32_t thr_c) {
       // printf("m: %d, %2d: %2d.%2d\n", m, thr_i, t + u, t + u + v);
     }
 
-    sync(thr_c);
+    barrier_wait(&barrier);
     // printf("\n");
   }
+
+  // the remaining stages only touch keys [2 * i_start, 2 * i_end), no other thread waits on them,
+  // their short strides run tile by tile
+  if (m < k) {
+    bitonicMergeStrides_u32_asc(buf + 2 * i_start, 2 * i_size, N >> (m + 1), 1);
+  }
 }
 
 struct g_worker_st {
   uint32_t n;
   uint32_t thr_c;
   uint32_t *buf;
+  uint32_t *tmp; // scratch keys of the merge sorts of the pieces
 };
 struct worker_st {
   int id;
@@ -209,25 +193,34 @@ void *worker(void *args) {
   uint32_t seq_s = (st->worker_shm->n / st->worker_shm->thr_c);
   uint32_t seq_i = seq_s * st->id;
 
-  merge_sort_asc(st->worker_shm->buf, seq_i, seq_s);
-  sync(st->worker_shm->thr_c);
+  merge_sort_asc(st->worker_shm->buf, st->worker_shm->tmp, seq_i, seq_s);
+  barrier_wait(&barrier);
 
   for (uint32_t i = st->worker_shm->thr_c >> 1; i > 0; i >>= 1) {
+    // the sequences of a level are disjoint, a thread may start the next one before the others finish
     for (int j = 0; j < i; j++) {
       bitonic_sort2(st->worker_shm->buf + (st->worker_shm->n / i) * j, st->worker_shm->n / i, st->id, st->worker_shm->thr_c);
     }
+    barrier_wait(&barrier);
   }
 
   return NULL;
 }
 
 void bitonic(uint32_t thr_c, uint32_t n, uint32_t *buf) {
-  // sync mutexs
-  pthread_mutex_init(&mut, NULL);
-  pthread_cond_init(&cond, NULL);
+  // the network sorts the largest power of 2 prefix, the rest is sorted the same way and merged at the end
+  uint64_t p = 1;
+  while (p * 2 <= n)
+    p *= 2;
+  if (p < (uint64_t)thr_c * thr_c) { // the first merges split n / (thr_c / 2) keys between all threads, each needs a pair
+    mergeSort_u32_asc(buf, n, NULL);
+    return;
+  }
+
+  barrier_init(&barrier, thr_c);
 
   pthread_t thr[thr_c];
-  struct g_worker_st worker_shm = {n, thr_c, buf};
+  struct g_worker_st worker_shm = {p, thr_c, buf, (uint32_t *)malloc(p * sizeof(uint32_t))};
   struct worker_st worker_args[thr_c];
 
   for (int i = 0; i < thr_c; i++) {
@@ -239,6 +232,12 @@ void bitonic(uint32_t thr_c, uint32_t n, uint32_t *buf) {
   for (int i = 0; i < thr_c; i++) {
     pthread_join(thr[i], NULL);
   }
+
+  if (p < n) { // n - p < p, the scratch keys are enough
+    bitonic(thr_c, n - p, buf + p);
+    mergeTail_u32_asc(buf, n, p, worker_shm.tmp);
+  }
+  free(worker_shm.tmp);
 }
 
 int main(int argc, char *argv[]) {
@@ -274,7 +273,7 @@ int main(int argc, char *argv[]) {
   printf("Time to bitonic sort: %fs\n", get_delta_time());
 
   // verify correcteness
-  for (int i = 0; i < n - 1; i++) {
+  for (int i = 0; i + 1 < n; i++) {
     if (buf[i] > buf[i + 1]) {
       printf("Not Sorted\n");
       break;
@@ -0,0 +1,67 @@
+/*
+ * K-way merge of sorted runs of one key type, included by external_sort.c with:
+ *   EXT_KEY       the key type
+ *   EXT_NAME(fn)  the name of fn for this key (fn_<key>)
+ * the runs are merged in ascending order
+ * no include guard on purpose
+ * */
+
+/**
+ * @brief !0 if the next key of run a goes before the next key of run b, an exhausted run goes last.
+ */
+static inline int EXT_NAME(runBeats)(const struct run_stream *runs, int a, int b) {
+  if (!runs[a].alive || !runs[b].alive)
+    return runs[a].alive;
+  EXT_KEY x = ((const EXT_KEY *)runs[a].buf)[runs[a].pos];
+  EXT_KEY y = ((const EXT_KEY *)runs[b].buf)[runs[b].pos];
+  return x < y || (!(y < x) && a < b); // ties (and NaNs) by run, the merge is stable
+}
+
+/**
+ * @brief Merges k sorted runs into out with a loser tree.
+ *
+ * The leaves of the tree are the runs, every inner node keeps the loser of the match of its two
+ * subtrees and tree[0] the winner. Taking a key only replays the matches from the leaf of its run
+ * to the root, log2(k) comparisons against the losers kept on the way.
+ */
+static void EXT_NAME(mergeRunFiles)(struct run_stream *runs, int k, struct out_stream *out) {
+  int *tree = (int *)malloc(k * sizeof(int));
+  int *win = (int *)malloc(2 * k * sizeof(int));
+
+  for (int n = 2 * k - 1; n >= k; n--) {
+    win[n] = n - k;
+  }
+  for (int n = k - 1; n > 0; n--) {
+    int a = win[2 * n], b = win[2 * n + 1];
+    int a_wins = EXT_NAME(runBeats)(runs, a, b);
+    win[n] = a_wins ? a : b;
+    tree[n] = a_wins ? b : a;
+  }
+  tree[0] = k > 1 ? win[1] : 0;
+
+  while (runs[tree[0]].alive) {
+    int w = tree[0];
+    struct run_stream *r = &runs[w];
+
+    ((EXT_KEY *)out->buf)[out->len++] = ((const EXT_KEY *)r->buf)[r->pos++];
+    if (out->len == out->cap) {
+      flushOut(out);
+    }
+    if (r->pos == r->len) {
+      refillRun(r);
+    }
+
+    for (int n = (w + k) / 2; n > 0; n /= 2) {
+      if (EXT_NAME(runBeats)(runs, tree[n], w)) {
+        int t = tree[n];
+        tree[n] = w;
+        w = t;
+      }
+    }
+    tree[0] = w;
+  }
+  flushOut(out);
+
+  free(tree);
+  free(win);
+}
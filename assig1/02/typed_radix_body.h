@@ -0,0 +1,86 @@
+/*
+ * LSD radix sort passes of one key width, included by radix_threaded.c with:
+ *   RADIX_KEY      the unsigned key type, the keys are already mapped so that their unsigned order is the sort order
+ *   RADIX_NAME(fn) the name of fn for this width (fn_u32, fn_u64)
+ *   RADIX_BITS     bits of a digit, RADIX_WC the keys of a write-combining line
+ *   radixStreamLine(dst, line), radixStreamFence() to write a whole line of dst
+ * no include guard on purpose
+ * */
+
+/**
+ * @brief Counts the digits at shift of n keys.
+ */
+static void RADIX_NAME(radixHistogram)(const RADIX_KEY *keys, long n, int shift, long *hist) {
+  memset(hist, 0, (1 << RADIX_BITS) * sizeof(long));
+  for (long i = 0; i < n; i++) {
+    hist[(keys[i] >> shift) & ((1 << RADIX_BITS) - 1)]++;
+  }
+}
+
+/**
+ * @brief Moves n keys to dst by their digit at shift, each digit from its offset on.
+ *
+ * The keys of a digit gather in a line of RADIX_WC keys that is written when full, so every
+ * write to dst fills a whole cache line (dst aligned to 64 bytes) with non-temporal stores that
+ * neither read the line first nor evict the lines being gathered.
+ * The first and last line of each digit may be partial, they are copied.
+ */
+static void RADIX_NAME(radixScatter)(const RADIX_KEY *src, long n, int shift, long *offset, RADIX_KEY *dst) {
+  static __thread RADIX_KEY wc[1 << RADIX_BITS][RADIX_WC] __attribute__((aligned(64)));
+  long base[1 << RADIX_BITS]; // first key of dst still in the line of each digit
+
+  memcpy(base, offset, sizeof(base));
+  for (long i = 0; i < n; i++) {
+    RADIX_KEY key = src[i];
+    int d = (key >> shift) & ((1 << RADIX_BITS) - 1);
+    long o = offset[d]++;
+
+    wc[d][o & (RADIX_WC - 1)] = key;
+    if (((o + 1) & (RADIX_WC - 1)) == 0) {
+      long b = base[d];
+      if (o + 1 - b == RADIX_WC) {
+        radixStreamLine(dst + b, wc[d]);
+      } else {
+        memcpy(dst + b, &wc[d][b & (RADIX_WC - 1)], (o + 1 - b) * sizeof(RADIX_KEY));
+      }
+      base[d] = o + 1;
+    }
+  }
+  for (int d = 0; d < 1 << RADIX_BITS; d++) {
+    long b = base[d];
+    memcpy(dst + b, &wc[d][b & (RADIX_WC - 1)], (offset[d] - b) * sizeof(RADIX_KEY));
+  }
+  radixStreamFence();
+}
+
+/**
+ * @brief Bit mask that maps a key to its unsigned order (applied with xor), from the key type.
+ *
+ * @param inverse 0 to map an original key, !0 to map a mapped key back.
+ */
+static inline RADIX_KEY RADIX_NAME(radixMask)(RADIX_KEY key, enum sort_key type, int inverse) {
+  const RADIX_KEY sign = (RADIX_KEY)1 << (sizeof(RADIX_KEY) * 8 - 1);
+  int negative = (key & sign) != 0;
+
+  switch (type) {
+  case SORT_KEY_i32:
+  case SORT_KEY_i64:
+    return sign;
+  case SORT_KEY_f32:
+  case SORT_KEY_f64: // a negative float has all bits flipped, a positive one only the sign
+    return negative != inverse ? (RADIX_KEY)~(RADIX_KEY)0 : sign;
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Maps n keys to their unsigned order, or back if inverse is !0.
+ */
+static void RADIX_NAME(radixMap)(RADIX_KEY *keys, long n, enum sort_key type, int inverse) {
+  if (type == SORT_KEY_u32 || type == SORT_KEY_u64)
+    return;
+  for (long i = 0; i < n; i++) {
+    keys[i] ^= RADIX_NAME(radixMask)(keys[i], type, inverse);
+  }
+}
@@ -0,0 +1,174 @@
+#ifndef TYPED_SORT_H
+#define TYPED_SORT_H
+
+/*
+ * Sort kernels for every key type and direction, header only so that it builds from C, MPI and CUDA (.cu) code.
+ *
+ * For each key (i32, u32, i64, u64, f32, f64) and direction (asc, desc) it defines, e.g. for u32 ascending:
+ *   compareAndSwap_u32_asc(a, b), compareAndSwapUp_u32_asc(a, b, up), bitonicStride_u32_asc(seq, n, j, up),
+ *   bitonicMergeStrides_u32_asc(seq, n, j_first, up), bitonicStages_u32_asc(seq, n, k_first),
+ *   bitonicMergeUp_u32_asc(seq, n, up), bitonicSortUp_u32_asc(seq, n, up), bitonicSort_u32_asc(seq, n),
+ *   bitonicMerge_u32_asc(seq, n), isSorted_u32_asc(seq, n), mergeRuns_u32_asc(a, na, b, nb, out),
+ *   insertionSort_u32_asc(buf, n, sorted), runEnd_u32_asc(buf, n, i), naturalRun_u32_asc(buf, n, i),
+ *   mergeSort_u32_asc(buf, n, tmp), mergeTail_u32_asc(buf, n, m, tmp)
+ * the comparison is a macro of each instantiation, so every kernel compiles to plain compares of its type.
+ * The bitonic and merge sorts start from blocks sorted in registers and merge runs in registers when the
+ * CPU has kernels for the key.
+ * Floats are compared with < and >, the order of NaNs is unspecified.
+ * */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __CUDACC__
+#define SORT_FN static inline __host__ __device__ // the networks also run in kernels
+#else
+#define SORT_FN static inline
+#endif
+
+#define SORT_TILE_BYTES (256 * 1024) // the bitonic strides inside a tile run while it is in L2
+#define SORT_MIN_RUN 32              // shortest run of the merge sort without kernels in registers, sorted by insertion
+
+#define SORT_ASC 0 // same directions as the -d option of the sorters
+#define SORT_DESC 1
+
+#define SORT_BEFORE_asc(a, b) ((a) < (b))
+#define SORT_BEFORE_desc(a, b) ((a) > (b))
+
+#define SORT_PASTE(fn, key, dir) fn##_##key##_##dir
+#define SORT_NAME_OF(fn, key, dir) SORT_PASTE(fn, key, dir)
+#define SORT_KEY_PASTE(fn, key) fn##_##key
+#define SORT_KEY_NAME_OF(fn, key) SORT_KEY_PASTE(fn, key)
+
+// X(suffix, type) for every key type
+#define SORT_KEYS(X) \
+  X(i32, int32_t)    \
+  X(u32, uint32_t)   \
+  X(i64, int64_t)    \
+  X(u64, uint64_t)   \
+  X(f32, float)      \
+  X(f64, double)
+
+#include "typed_sort_simd.h"
+
+#define SORT_KEY int32_t
+#define SORT_SUFFIX i32
+#include "typed_sort_dirs.h"
+#define SORT_KEY uint32_t
+#define SORT_SUFFIX u32
+#include "typed_sort_dirs.h"
+#define SORT_KEY int64_t
+#define SORT_SUFFIX i64
+#include "typed_sort_dirs.h"
+#define SORT_KEY uint64_t
+#define SORT_SUFFIX u64
+#include "typed_sort_dirs.h"
+#define SORT_KEY float
+#define SORT_SUFFIX f32
+#include "typed_sort_dirs.h"
+#define SORT_KEY double
+#define SORT_SUFFIX f64
+#include "typed_sort_dirs.h"
+
+/**
+ * @brief Key type picked at run time, e.g. from the command line.
+ */
+enum sort_key {
+#define SORT_KEY_ENUM(suffix, type) SORT_KEY_##suffix,
+  SORT_KEYS(SORT_KEY_ENUM)
+#undef SORT_KEY_ENUM
+  SORT_KEY_TYPES
+};
+
+/**
+ * @brief Parses a key type name ("i32", "u32", "i64", "u64", "f32" or "f64").
+ *
+ * @return 0 on success, -1 if the name is unknown.
+ */
+static inline int parseSortKey(const char *arg, enum sort_key *key) {
+#define SORT_KEY_PARSE(suffix, type) \
+  if (strcmp(arg, #suffix) == 0) {   \
+    *key = SORT_KEY_##suffix;        \
+    return 0;                        \
+  }
+  SORT_KEYS(SORT_KEY_PARSE)
+#undef SORT_KEY_PARSE
+  return -1;
+}
+
+/**
+ * @brief Size in bytes of a key type.
+ */
+static inline int sortKeySize(enum sort_key key) {
+  switch (key) {
+#define SORT_KEY_SIZE(suffix, type) \
+  case SORT_KEY_##suffix:           \
+    return sizeof(type);
+    SORT_KEYS(SORT_KEY_SIZE)
+#undef SORT_KEY_SIZE
+  default:
+    return 0;
+  }
+}
+
+/**
+ * @brief Merge sorts n keys of a type picked at run time.
+ *
+ * @param direction SORT_ASC or SORT_DESC.
+ * @param tmp n keys of scratch space, or NULL to allocate them.
+ */
+static inline void mergeSortKeys(void *buf, long n, enum sort_key key, int direction, void *tmp) {
+  switch (key) {
+#define SORT_KEY_MERGE(suffix, type)                                \
+  case SORT_KEY_##suffix:                                           \
+    if (direction == SORT_ASC)                                      \
+      SORT_NAME_OF(mergeSort, suffix, asc)((type *)buf, n, (type *)tmp); \
+    else                                                            \
+      SORT_NAME_OF(mergeSort, suffix, desc)((type *)buf, n, (type *)tmp); \
+    break;
+    SORT_KEYS(SORT_KEY_MERGE)
+#undef SORT_KEY_MERGE
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief Bitonic sorts n keys of a type picked at run time.
+ *
+ * @param direction SORT_ASC or SORT_DESC.
+ */
+static inline void bitonicSortKeys(void *buf, long n, enum sort_key key, int direction) {
+  switch (key) {
+#define SORT_KEY_BITONIC(suffix, type)                         \
+  case SORT_KEY_##suffix:                                      \
+    if (direction == SORT_ASC)                                 \
+      SORT_NAME_OF(bitonicSort, suffix, asc)((type *)buf, n);  \
+    else                                                       \
+      SORT_NAME_OF(bitonicSort, suffix, desc)((type *)buf, n); \
+    break;
+    SORT_KEYS(SORT_KEY_BITONIC)
+#undef SORT_KEY_BITONIC
+  default:
+    break;
+  }
+}
+
+/**
+ * @brief !0 if n keys of a type picked at run time are in the direction.
+ */
+static inline int isSortedKeys(const void *buf, long n, enum sort_key key, int direction) {
+  switch (key) {
+#define SORT_KEY_SORTED(suffix, type)                                                  \
+  case SORT_KEY_##suffix:                                                              \
+    return direction == SORT_ASC ? SORT_NAME_OF(isSorted, suffix, asc)((const type *)buf, n) \
+                                 : SORT_NAME_OF(isSorted, suffix, desc)((const type *)buf, n);
+    SORT_KEYS(SORT_KEY_SORTED)
+#undef SORT_KEY_SORTED
+  default:
+    return 0;
+  }
+}
+
+#endif
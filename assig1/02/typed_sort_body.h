@@ -0,0 +1,338 @@
+/*
+ * Body of the typed sort kernels, included by typed_sort.h once per key type and direction with:
+ *   SORT_KEY       the key type
+ *   SORT_NAME(fn)  the name of fn for this key and direction (fn_<key>_<direction>)
+ *   SORT_BEFORE    SORT_BEFORE(a, b) is !0 if a goes strictly before b
+ *   SORT_ASCENDING 1 if the direction is ascending, 0 otherwise
+ *   SORT_SUFFIX    the key suffix, for the block kernels of typed_sort_simd.h
+ * no include guard on purpose
+ * */
+
+/**
+ * @brief Puts the two keys in order, a first.
+ */
+SORT_FN void SORT_NAME(compareAndSwap)(SORT_KEY *a, SORT_KEY *b) {
+  if (SORT_BEFORE(*b, *a)) {
+    SORT_KEY t = *a;
+    *a = *b;
+    *b = t;
+  }
+}
+
+/**
+ * @brief Puts the two keys in the order of a block of a bitonic network, reversed if up is 0.
+ */
+SORT_FN void SORT_NAME(compareAndSwapUp)(SORT_KEY *a, SORT_KEY *b, int up) {
+  if (up ? SORT_BEFORE(*b, *a) : SORT_BEFORE(*a, *b)) {
+    SORT_KEY t = *a;
+    *a = *b;
+    *b = t;
+  }
+}
+
+/**
+ * @brief Compares every key of blocks of 2 * j keys with the one j keys after it, n a multiple of 2 * j.
+ */
+SORT_FN void SORT_NAME(bitonicStride)(SORT_KEY *sequence, long n, long j, int up) {
+  for (long b = 0; b < n; b += 2 * j) {
+    SORT_KEY *x = sequence + b, *y = sequence + b + j;
+    for (long i = 0; i < j; i++) { // selects instead of a branch, the loop vectorizes
+      SORT_KEY p = x[i], q = y[i];
+      int swap = up ? SORT_BEFORE(q, p) : SORT_BEFORE(p, q);
+      x[i] = swap ? q : p;
+      y[i] = swap ? p : q;
+    }
+  }
+}
+
+/**
+ * @brief Strides j_first, j_first / 2, ..., 1 of the merges of blocks of 2 * j_first keys (n a multiple of it),
+ * in the sort direction or reversed if up is 0.
+ *
+ * The strides longer than a tile sweep the whole sequence, the shorter ones all run on a tile
+ * before the next one, while it is still in cache.
+ */
+SORT_FN void SORT_NAME(bitonicMergeStrides)(SORT_KEY *sequence, long n, long j_first, int up) {
+  long tile = SORT_TILE_BYTES / sizeof(SORT_KEY);
+  long j = j_first;
+
+  for (; j > 0 && 2 * j > tile; j /= 2) {
+    SORT_NAME(bitonicStride)(sequence, n, j, up);
+  }
+  if (j == 0)
+    return;
+  for (long lo = 0; lo < n; lo += tile) {
+    long len = n - lo < tile ? n - lo : tile; // a multiple of 2 * j
+    for (long jj = j; jj > 0; jj /= 2) {
+      SORT_NAME(bitonicStride)(sequence + lo, len, jj, up);
+    }
+  }
+}
+
+/**
+ * @brief Bitonic network from the stages of blocks of k_first keys up to n, n a power of 2.
+ *
+ * Blocks of k keys go in the sort direction when (i & k) == 0 and reversed otherwise,
+ * so each stage leaves the bitonic sequences the next one merges.
+ * All the stages of blocks up to a tile run on a tile before the next one, the longer
+ * ones keep their short strides inside a tile (see bitonicMergeStrides).
+ */
+SORT_FN void SORT_NAME(bitonicStages)(SORT_KEY *sequence, long n, long k_first) {
+  long tile = SORT_TILE_BYTES / sizeof(SORT_KEY);
+  if (tile > n)
+    tile = n;
+
+  for (long lo = 0; lo < n; lo += tile) {
+    for (long k = k_first; k <= tile; k *= 2) {
+      for (long b = lo; b < lo + tile; b += k) {
+        SORT_NAME(bitonicMergeStrides)(sequence + b, k, k / 2, (b & k) == 0);
+      }
+    }
+  }
+  for (long k = k_first > 2 * tile ? k_first : 2 * tile; k <= n; k *= 2) {
+    for (long b = 0; b < n; b += k) {
+      SORT_NAME(bitonicMergeStrides)(sequence + b, k, k / 2, (b & k) == 0);
+    }
+  }
+}
+
+/**
+ * @brief Merges a bitonic sequence of any length made of a reversed run followed by a run
+ * (as left by bitonicSortUp), in the sort direction or reversed if up is 0.
+ *
+ * Behaves as the power of 2 network with the sequence virtually padded by keys that never
+ * move, so only the pairs with both keys in the sequence are compared.
+ */
+SORT_FN void SORT_NAME(bitonicMergeUp)(SORT_KEY *sequence, long n, int up) {
+  if (n < 2)
+    return;
+  long m = 1; // greatest power of 2 below n
+  while (m * 2 < n)
+    m *= 2;
+  for (long i = 0; i < n - m; i++) {
+    SORT_NAME(compareAndSwapUp)(&sequence[i], &sequence[i + m], up);
+  }
+  SORT_NAME(bitonicMergeUp)(sequence, m, up);
+  SORT_NAME(bitonicMergeUp)(sequence + m, n - m, up);
+}
+
+/**
+ * @brief Bitonic network for any n, in the sort direction or reversed if up is 0.
+ */
+SORT_FN void SORT_NAME(bitonicSortUp)(SORT_KEY *sequence, long n, int up) {
+  if (n < 2)
+    return;
+  if (n <= SORT_KEY_NAME_OF(sortBlockSize, SORT_SUFFIX)()) {
+    SORT_KEY_NAME_OF(sortBlock, SORT_SUFFIX)(sequence, n, up == SORT_ASCENDING);
+    return;
+  }
+  SORT_NAME(bitonicSortUp)(sequence, n / 2, !up);
+  SORT_NAME(bitonicSortUp)(sequence + n / 2, n - n / 2, up);
+  SORT_NAME(bitonicMergeUp)(sequence, n, up);
+}
+
+/**
+ * @brief Sorts n keys with the bitonic network, in place for any n.
+ */
+SORT_FN void SORT_NAME(bitonicSort)(SORT_KEY *sequence, long n) {
+  long block = SORT_KEY_NAME_OF(sortBlockSize, SORT_SUFFIX)();
+  if ((n & (n - 1)) == 0 && block > 0 && n >= block) {
+    // the first stages are done in registers, blocks alternate directions as the network leaves them
+    for (long i = 0; i < n; i += block) {
+      SORT_KEY_NAME_OF(sortBlock, SORT_SUFFIX)(sequence + i, block, ((i & block) == 0) == SORT_ASCENDING);
+    }
+    SORT_NAME(bitonicStages)(sequence, n, 2 * block);
+  } else if ((n & (n - 1)) == 0) {
+    SORT_NAME(bitonicStages)(sequence, n, 2);
+  } else {
+    SORT_NAME(bitonicSortUp)(sequence, n, 1);
+  }
+}
+
+/**
+ * @brief Sorts n keys (any n) made of two sorted halves, the first one has n / 2 keys.
+ *
+ * The first half is reversed so that the sequence is bitonic and then merged.
+ */
+SORT_FN void SORT_NAME(bitonicMerge)(SORT_KEY *sequence, long n) {
+  if (n < 2)
+    return;
+  for (long i = 0, j = n / 2 - 1; i < j; i++, j--) {
+    SORT_KEY t = sequence[i];
+    sequence[i] = sequence[j];
+    sequence[j] = t;
+  }
+  if ((n & (n - 1)) == 0) {
+    SORT_NAME(bitonicStages)(sequence, n, n);
+  } else {
+    SORT_NAME(bitonicMergeUp)(sequence, n, 1);
+  }
+}
+
+/**
+ * @brief !0 if the n keys are in the sort direction.
+ */
+SORT_FN int SORT_NAME(isSorted)(const SORT_KEY *sequence, long n) {
+  for (long i = 1; i < n; i++) {
+    if (SORT_BEFORE(sequence[i], sequence[i - 1]))
+      return 0;
+  }
+  return 1;
+}
+
+/**
+ * @brief Merges the sorted runs a and b into out, in registers if the CPU has a kernel for the key.
+ *
+ * The scalar merge is branchless, the run to take from is picked with a conditional move.
+ */
+static inline void SORT_NAME(mergeRuns)(const SORT_KEY *a, long na, const SORT_KEY *b, long nb, SORT_KEY *out) {
+  if (SORT_KEY_NAME_OF(sortBlockSize, SORT_SUFFIX)() > 0) {
+    SORT_KEY_NAME_OF(sortMergeRuns, SORT_SUFFIX)(a, na, b, nb, out, SORT_ASCENDING);
+    return;
+  }
+
+  long i = 0, j = 0;
+  while (i < na && j < nb) {
+    SORT_KEY x = a[i], y = b[j];
+    int from_b = SORT_BEFORE(y, x); // ties take the key of the first run
+    *out++ = from_b ? y : x;
+    j += from_b;
+    i += !from_b;
+  }
+  memcpy(out, a + i, (na - i) * sizeof(SORT_KEY));
+  memcpy(out + na - i, b + j, (nb - j) * sizeof(SORT_KEY));
+}
+
+/**
+ * @brief Sorts n keys by insertion, the first sorted ones are already in order.
+ */
+static inline void SORT_NAME(insertionSort)(SORT_KEY *buf, long n, long sorted) {
+  for (long i = sorted > 1 ? sorted : 1; i < n; i++) {
+    SORT_KEY key = buf[i];
+    long j = i;
+    for (; j > 0 && SORT_BEFORE(key, buf[j - 1]); j--) {
+      buf[j] = buf[j - 1];
+    }
+    buf[j] = key;
+  }
+}
+
+/**
+ * @brief End of the run in the sort direction that starts at key i (i < n).
+ */
+static inline long SORT_NAME(runEnd)(const SORT_KEY *buf, long n, long i) {
+  long e = i + 1;
+  for (; e + 32 <= n; e += 32) { // no branch per key, the check of 32 keys vectorizes
+    int down = 0;
+    for (int k = 0; k < 32; k++) {
+      down |= SORT_BEFORE(buf[e + k], buf[e + k - 1]);
+    }
+    if (down)
+      break;
+  }
+  while (e < n && !SORT_BEFORE(buf[e], buf[e - 1]))
+    e++;
+  return e;
+}
+
+/**
+ * @brief End of the run that starts at key i (i < n), a strictly reversed run is turned around.
+ */
+static inline long SORT_NAME(naturalRun)(SORT_KEY *buf, long n, long i) {
+  if (i + 1 == n || !SORT_BEFORE(buf[i + 1], buf[i]))
+    return SORT_NAME(runEnd)(buf, n, i);
+
+  long e = i + 2;
+  while (e < n && SORT_BEFORE(buf[e], buf[e - 1]))
+    e++;
+  for (long a = i, b = e - 1; a < b; a++, b--) {
+    SORT_KEY t = buf[a];
+    buf[a] = buf[b];
+    buf[b] = t;
+  }
+  return e;
+}
+
+/**
+ * @brief Natural bottom up merge sort of n keys (any n).
+ *
+ * The keys already in order, or reversed, are taken as runs; a shorter run than a block is
+ * extended to a block sorted in registers if the CPU can, by insertion otherwise. Each pass
+ * merges pairs of runs from one buffer to the other, found again by their first key out of
+ * order, so the keys are copied back at most once, when the last pass leaves them in tmp.
+ *
+ * @param tmp n keys of scratch space, or NULL to allocate them (only if there is more than one run,
+ * the keys are sorted in place by the bitonic network if the allocation fails).
+ */
+static inline void SORT_NAME(mergeSort)(SORT_KEY *buf, long n, SORT_KEY *tmp) {
+  long block = SORT_KEY_NAME_OF(sortBlockSize, SORT_SUFFIX)();
+  long min_run = block > 0 ? block : SORT_MIN_RUN;
+  long runs = 0;
+
+  for (long i = 0; i < n;) {
+    long e = SORT_NAME(naturalRun)(buf, n, i);
+    if (e - i < min_run && e < n) {
+      long end = n - i < min_run ? n : i + min_run;
+      if (block > 0) {
+        SORT_KEY_NAME_OF(sortBlock, SORT_SUFFIX)(buf + i, end - i, SORT_ASCENDING);
+      } else {
+        SORT_NAME(insertionSort)(buf + i, end - i, e - i);
+      }
+      e = end;
+    }
+    runs += i == 0 || SORT_BEFORE(buf[i], buf[i - 1]); // a run in order after the previous one joins it
+    i = e;
+  }
+  if (runs < 2)
+    return;
+
+  SORT_KEY *ntemp = tmp != NULL ? tmp : (SORT_KEY *)malloc(n * sizeof(SORT_KEY));
+  if (ntemp == NULL) { // no scratch space, the bitonic network sorts in place
+    SORT_NAME(bitonicSortUp)(buf, n, 1);
+    return;
+  }
+  SORT_KEY *src = buf, *dst = ntemp;
+
+  while (runs > 1) {
+    runs = 0;
+    for (long i = 0; i < n;) {
+      long mid = SORT_NAME(runEnd)(src, n, i);
+      long end = mid < n ? SORT_NAME(runEnd)(src, n, mid) : n;
+      if (mid < end) {
+        SORT_NAME(mergeRuns)(src + i, mid - i, src + mid, end - mid, dst + i);
+      } else {
+        memcpy(dst + i, src + i, (end - i) * sizeof(SORT_KEY));
+      }
+      runs += i == 0 || SORT_BEFORE(dst[i], dst[i - 1]);
+      i = end;
+    }
+    SORT_KEY *t = src;
+    src = dst;
+    dst = t;
+  }
+  if (src != buf) {
+    memcpy(buf, src, n * sizeof(SORT_KEY));
+  }
+
+  if (tmp == NULL) {
+    free(ntemp);
+  }
+}
+
+/**
+ * @brief Merges the sorted keys buf[0, m) and buf[m, n) in place, from the back.
+ *
+ * @param tmp n - m keys of scratch space, the second run is copied there.
+ */
+static inline void SORT_NAME(mergeTail)(SORT_KEY *buf, long n, long m, SORT_KEY *tmp) {
+  long i = m - 1, j = n - m - 1, k = n - 1;
+
+  memcpy(tmp, buf + m, (n - m) * sizeof(SORT_KEY));
+  while (j >= 0) {
+    if (i >= 0 && SORT_BEFORE(tmp[j], buf[i])) { // ties keep the key of the second run last
+      buf[k--] = buf[i--];
+    } else {
+      buf[k--] = tmp[j--];
+    }
+  }
+}
@@ -0,0 +1,23 @@
+/*
+ * Instantiates typed_sort_body.h in both directions for SORT_KEY / SORT_SUFFIX (see typed_sort.h),
+ * no include guard on purpose, both macros are undefined at the end
+ * */
+
+#define SORT_NAME(fn) SORT_NAME_OF(fn, SORT_SUFFIX, asc)
+#define SORT_BEFORE SORT_BEFORE_asc
+#define SORT_ASCENDING 1
+#include "typed_sort_body.h"
+#undef SORT_NAME
+#undef SORT_BEFORE
+#undef SORT_ASCENDING
+
+#define SORT_NAME(fn) SORT_NAME_OF(fn, SORT_SUFFIX, desc)
+#define SORT_BEFORE SORT_BEFORE_desc
+#define SORT_ASCENDING 0
+#include "typed_sort_body.h"
+#undef SORT_NAME
+#undef SORT_BEFORE
+#undef SORT_ASCENDING
+
+#undef SORT_KEY
+#undef SORT_SUFFIX
@@ -0,0 +1,265 @@
+/*
+ * Base case of the typed sort kernels: blocks of keys sorted in registers (AVX2 or AVX-512, picked at run time),
+ * and a two way merge in registers, included by typed_sort.h. For each key it defines sortBlockSize_<key>(),
+ * sortBlock_<key>(keys, n, ascending) and sortMergeRuns_<key>(a, na, b, nb, out, ascending),
+ * the block size is 0 when there are no kernels for the key on this CPU (or in CUDA code).
+ * */
+
+#if !defined(__CUDACC__) && defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define HAVE_SORT_SIMD 1
+#endif
+
+#ifdef HAVE_SORT_SIMD
+
+/**
+ * @brief Lanes of a bitonic network step that keep the smaller key, as a bit mask.
+ *
+ * Lane l is compared with lane l ^ d and keeps the smaller key if it is the first of the
+ * pair in a block of k lanes sorted up ((l & k) == 0), or the second in a block sorted down.
+ */
+static inline unsigned sortLanes(int w, int k, int d) {
+  unsigned bits = 0;
+  for (int l = 0; l < w; l++) {
+    if (((l & d) == 0) == ((l & k) == 0))
+      bits |= 1u << l;
+  }
+  return bits;
+}
+
+/**
+ * @brief 2 if the CPU has AVX-512, 1 if it has AVX2, 0 otherwise.
+ *
+ * Cached on the first call, threads that race on it all store the same value.
+ */
+static inline int sortSimdLevel(void) {
+  static int level = -1;
+  int l = __atomic_load_n(&level, __ATOMIC_RELAXED);
+  if (l == -1) {
+    l = __builtin_cpu_supports("avx512f") ? 2 : __builtin_cpu_supports("avx2") ? 1 : 0;
+    __atomic_store_n(&level, l, __ATOMIC_RELAXED);
+  }
+  return l;
+}
+
+// AVX2, 8 lanes of 32 bits, 8 registers: blocks of 64 keys
+#define SIMD_TARGET "avx2"
+#define SIMD_V __m256i
+#define SIMD_W 8
+#define SIMD_R 8
+#define SIMD_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define SIMD_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define SIMD_XOR_INDEX(d) _mm256_xor_si256(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(d))
+#define SIMD_REVERSE_INDEX _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0)
+#define SIMD_PERMUTE(v, index) _mm256_permutevar8x32_epi32(v, index)
+#define SIMD_LANE_BITS _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128)
+#define SIMD_SELECT(bits, lo, hi) \
+  _mm256_blendv_epi8(hi, lo, _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), SIMD_LANE_BITS), SIMD_LANE_BITS))
+
+#define SIMD_NAME(fn) fn##_avx2_i32
+#define SIMD_KEY int32_t
+#define SIMD_PAD INT32_MAX
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm256_min_epi32(a, b), hi = _mm256_max_epi32(a, b))
+#define SIMD_ORDER(v) (v)
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+#define SIMD_NAME(fn) fn##_avx2_u32
+#define SIMD_KEY uint32_t
+#define SIMD_PAD UINT32_MAX
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm256_min_epu32(a, b), hi = _mm256_max_epu32(a, b))
+#define SIMD_ORDER(v) (v)
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+// floats are sorted as integers: the magnitude bits of the negative ones are flipped, so that
+// the keys of the two lanes of a pair are swapped or kept as a whole even for NaNs,
+// which go first (sign set) or last, the pad is the greatest NaN to stay behind them
+#define SIMD_NAME(fn) fn##_avx2_f32
+#define SIMD_KEY float
+#define SIMD_PAD __builtin_nanf("0x7fffff")
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm256_min_epi32(a, b), hi = _mm256_max_epi32(a, b))
+#define SIMD_ORDER(v) _mm256_xor_si256(v, _mm256_srli_epi32(_mm256_srai_epi32(v, 31), 1))
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+#undef SIMD_TARGET
+#undef SIMD_V
+#undef SIMD_W
+#undef SIMD_R
+#undef SIMD_LOAD
+#undef SIMD_STORE
+#undef SIMD_XOR_INDEX
+#undef SIMD_REVERSE_INDEX
+#undef SIMD_PERMUTE
+#undef SIMD_LANE_BITS
+#undef SIMD_SELECT
+
+// AVX-512, 16 registers: blocks of 256 keys of 32 bits or 128 keys of 64 bits
+#define SIMD_TARGET "avx512f"
+#define SIMD_V __m512i
+#define SIMD_R 16
+#define SIMD_LOAD(p) _mm512_loadu_si512((const void *)(p))
+#define SIMD_STORE(p, v) _mm512_storeu_si512((void *)(p), v)
+
+#define SIMD_W 16
+#define SIMD_XOR_INDEX(d) \
+  _mm512_xor_si512(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15), _mm512_set1_epi32(d))
+#define SIMD_REVERSE_INDEX _mm512_setr_epi32(15, 14, 13, 12, 11, 10, 9, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define SIMD_PERMUTE(v, index) _mm512_permutexvar_epi32(index, v)
+#define SIMD_SELECT(bits, lo, hi) _mm512_mask_blend_epi32((__mmask16)(bits), hi, lo)
+
+#define SIMD_NAME(fn) fn##_avx512_i32
+#define SIMD_KEY int32_t
+#define SIMD_PAD INT32_MAX
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm512_min_epi32(a, b), hi = _mm512_max_epi32(a, b))
+#define SIMD_ORDER(v) (v)
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+#define SIMD_NAME(fn) fn##_avx512_u32
+#define SIMD_KEY uint32_t
+#define SIMD_PAD UINT32_MAX
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm512_min_epu32(a, b), hi = _mm512_max_epu32(a, b))
+#define SIMD_ORDER(v) (v)
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+#define SIMD_NAME(fn) fn##_avx512_f32
+#define SIMD_KEY float
+#define SIMD_PAD __builtin_nanf("0x7fffff")
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm512_min_epi32(a, b), hi = _mm512_max_epi32(a, b))
+#define SIMD_ORDER(v) _mm512_xor_si512(v, _mm512_srli_epi32(_mm512_srai_epi32(v, 31), 1))
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+#undef SIMD_W
+#undef SIMD_XOR_INDEX
+#undef SIMD_REVERSE_INDEX
+#undef SIMD_PERMUTE
+#undef SIMD_SELECT
+
+#define SIMD_W 8
+#define SIMD_XOR_INDEX(d) _mm512_xor_si512(_mm512_setr_epi64(0, 1, 2, 3, 4, 5, 6, 7), _mm512_set1_epi64(d))
+#define SIMD_REVERSE_INDEX _mm512_setr_epi64(7, 6, 5, 4, 3, 2, 1, 0)
+#define SIMD_PERMUTE(v, index) _mm512_permutexvar_epi64(index, v)
+#define SIMD_SELECT(bits, lo, hi) _mm512_mask_blend_epi64((__mmask8)(bits), hi, lo)
+
+#define SIMD_NAME(fn) fn##_avx512_i64
+#define SIMD_KEY int64_t
+#define SIMD_PAD INT64_MAX
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm512_min_epi64(a, b), hi = _mm512_max_epi64(a, b))
+#define SIMD_ORDER(v) (v)
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+#define SIMD_NAME(fn) fn##_avx512_u64
+#define SIMD_KEY uint64_t
+#define SIMD_PAD UINT64_MAX
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm512_min_epu64(a, b), hi = _mm512_max_epu64(a, b))
+#define SIMD_ORDER(v) (v)
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+#define SIMD_NAME(fn) fn##_avx512_f64
+#define SIMD_KEY double
+#define SIMD_PAD __builtin_nan("0xfffffffffffff")
+#define SIMD_MINMAX(a, b, lo, hi) (lo = _mm512_min_epi64(a, b), hi = _mm512_max_epi64(a, b))
+#define SIMD_ORDER(v) _mm512_xor_si512(v, _mm512_srli_epi64(_mm512_srai_epi64(v, 63), 1))
+#include "typed_sort_simd_body.h"
+#undef SIMD_NAME
+#undef SIMD_KEY
+#undef SIMD_PAD
+#undef SIMD_MINMAX
+#undef SIMD_ORDER
+
+#undef SIMD_W
+#undef SIMD_XOR_INDEX
+#undef SIMD_REVERSE_INDEX
+#undef SIMD_PERMUTE
+#undef SIMD_SELECT
+#undef SIMD_TARGET
+#undef SIMD_V
+#undef SIMD_R
+#undef SIMD_LOAD
+#undef SIMD_STORE
+
+// keys of 32 bits have both kernels, keys of 64 bits only the AVX-512 one
+#define SORT_SIMD_32(suffix, type)                                                       \
+  static inline long sortBlockSize_##suffix(void) {                                      \
+    return sortSimdLevel() == 2 ? 256 : sortSimdLevel() == 1 ? 64 : 0;                   \
+  }                                                                                      \
+  static inline void sortBlock_##suffix(type *keys, long n, int ascending) {             \
+    if (sortSimdLevel() == 2)                                                            \
+      sortBlock_avx512_##suffix(keys, n, ascending);                                     \
+    else                                                                                 \
+      sortBlock_avx2_##suffix(keys, n, ascending);                                       \
+  }                                                                                      \
+  static inline void sortMergeRuns_##suffix(const type *a, long na, const type *b, long nb, type *out, int ascending) { \
+    if (sortSimdLevel() == 2)                                                            \
+      mergeRuns_avx512_##suffix(a, na, b, nb, out, ascending);                           \
+    else                                                                                 \
+      mergeRuns_avx2_##suffix(a, na, b, nb, out, ascending);                             \
+  }
+#define SORT_SIMD_64(suffix, type)                                                       \
+  static inline long sortBlockSize_##suffix(void) { return sortSimdLevel() == 2 ? 128 : 0; } \
+  static inline void sortBlock_##suffix(type *keys, long n, int ascending) { sortBlock_avx512_##suffix(keys, n, ascending); } \
+  static inline void sortMergeRuns_##suffix(const type *a, long na, const type *b, long nb, type *out, int ascending) { \
+    mergeRuns_avx512_##suffix(a, na, b, nb, out, ascending);                             \
+  }
+
+SORT_SIMD_32(i32, int32_t)
+SORT_SIMD_32(u32, uint32_t)
+SORT_SIMD_32(f32, float)
+SORT_SIMD_64(i64, int64_t)
+SORT_SIMD_64(u64, uint64_t)
+SORT_SIMD_64(f64, double)
+#undef SORT_SIMD_32
+#undef SORT_SIMD_64
+
+#else
+
+#define SORT_SIMD_NONE(suffix, type)                                                                                  \
+  SORT_FN long sortBlockSize_##suffix(void) { return 0; }                                                             \
+  SORT_FN void sortBlock_##suffix(type *keys, long n, int ascending) {                                                \
+    (void)keys, (void)n, (void)ascending;                                                                             \
+  }                                                                                                                   \
+  static inline void sortMergeRuns_##suffix(const type *a, long na, const type *b, long nb, type *out, int ascending) { \
+    (void)a, (void)na, (void)b, (void)nb, (void)out, (void)ascending;                                                 \
+  }
+SORT_KEYS(SORT_SIMD_NONE)
+#undef SORT_SIMD_NONE
+
+#endif
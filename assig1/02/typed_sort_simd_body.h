@@ -0,0 +1,198 @@
+/*
+ * In-register sorting network of one key type and instruction set, included by typed_sort_simd.h with:
+ *   SIMD_NAME(fn)              the name of fn for this instruction set and key (fn_<isa>_<key>)
+ *   SIMD_TARGET                the target attribute of the kernels
+ *   SIMD_KEY, SIMD_PAD         the key type and its greatest value (in the order of SIMD_MINMAX)
+ *   SIMD_V, SIMD_W, SIMD_R     the register type, keys per register and registers per block
+ *   SIMD_LOAD(p), SIMD_STORE(p, v)
+ *   SIMD_MINMAX(a, b, lo, hi)  the smaller and the greater key of each lane
+ *   SIMD_ORDER(v)              the keys of v as SIMD_MINMAX compares them, its own inverse (the identity for integers)
+ *   SIMD_XOR_INDEX(d)          the lane indexes l ^ d, SIMD_REVERSE_INDEX the lane indexes W - 1 - l
+ *   SIMD_PERMUTE(v, index)     lane l taken from lane index[l]
+ *   SIMD_SELECT(bits, lo, hi)  lane l taken from lo if bit l of bits is set, from hi otherwise
+ * the loops over lanes and registers are unrolled so that the lane masks are constants
+ * no include guard on purpose
+ * */
+
+/**
+ * @brief Bitonic merge inside a register whose lanes are a bitonic sequence, ascending or descending.
+ */
+__attribute__((target(SIMD_TARGET), always_inline)) static inline SIMD_V SIMD_NAME(mergeLanes)(SIMD_V v, int ascending) {
+  #pragma GCC unroll 16
+  for (int d = SIMD_W / 2; d > 0; d /= 2) {
+    SIMD_V s = SIMD_PERMUTE(v, SIMD_XOR_INDEX(d)), lo, hi;
+    SIMD_MINMAX(v, s, lo, hi);
+    v = ascending ? SIMD_SELECT(sortLanes(SIMD_W, SIMD_W, d), lo, hi) : SIMD_SELECT(sortLanes(SIMD_W, SIMD_W, d), hi, lo);
+  }
+  return v;
+}
+
+/**
+ * @brief Sorts the SIMD_R registers of a block as one ascending sequence, register 0 first.
+ *
+ * Each register is sorted by a bitonic network over its lanes, then the sorted
+ * registers are merged in pairs, the second run reversed so that the two are bitonic.
+ */
+__attribute__((target(SIMD_TARGET))) static inline void SIMD_NAME(sortRegisters)(SIMD_V *v) {
+  #pragma GCC unroll 16
+  for (int r = 0; r < SIMD_R; r++) {
+    #pragma GCC unroll 16
+    for (int k = 2; k <= SIMD_W; k *= 2) {
+      #pragma GCC unroll 16
+      for (int d = k / 2; d > 0; d /= 2) {
+        SIMD_V s = SIMD_PERMUTE(v[r], SIMD_XOR_INDEX(d)), lo, hi;
+        SIMD_MINMAX(v[r], s, lo, hi);
+        v[r] = SIMD_SELECT(sortLanes(SIMD_W, k, d), lo, hi);
+      }
+    }
+  }
+
+  #pragma GCC unroll 16
+  for (int m = 1; m < SIMD_R; m *= 2) {
+    #pragma GCC unroll 16
+    for (SIMD_V *a = v; a < v + SIMD_R; a += 2 * m) {
+      SIMD_V *b = a + m;
+      #pragma GCC unroll 16
+      for (int i = 0; i < (m + 1) / 2; i++) {
+        SIMD_V t = SIMD_PERMUTE(b[i], SIMD_REVERSE_INDEX);
+        b[i] = SIMD_PERMUTE(b[m - 1 - i], SIMD_REVERSE_INDEX);
+        b[m - 1 - i] = t;
+      }
+      #pragma GCC unroll 16
+      for (int dist = m; dist > 0; dist /= 2) {
+        #pragma GCC unroll 16
+        for (int i = 0; i < 2 * m; i++) {
+          if ((i & dist) == 0) {
+            SIMD_V lo, hi;
+            SIMD_MINMAX(a[i], a[i + dist], lo, hi);
+            a[i] = lo;
+            a[i + dist] = hi;
+          }
+        }
+      }
+      #pragma GCC unroll 16
+      for (int i = 0; i < 2 * m; i++) {
+        a[i] = SIMD_NAME(mergeLanes)(a[i], 1);
+      }
+    }
+  }
+}
+
+/**
+ * @brief Sorts up to SIMD_W * SIMD_R keys in registers, a short block is padded with SIMD_PAD.
+ */
+__attribute__((target(SIMD_TARGET))) static void SIMD_NAME(sortBlock)(SIMD_KEY *keys, long n, int ascending) {
+  SIMD_KEY buf[SIMD_W * SIMD_R] __attribute__((aligned(64)));
+  SIMD_V v[SIMD_R];
+  int direct;
+
+  if (n > SIMD_W * SIMD_R) // never asked for, bounds the copies
+    n = SIMD_W * SIMD_R;
+  direct = ascending && n == SIMD_W * SIMD_R;
+
+  if (!direct) {
+    memcpy(buf, keys, n * sizeof(SIMD_KEY));
+    for (long i = n; i < SIMD_W * SIMD_R; i++) {
+      buf[i] = SIMD_PAD;
+    }
+  }
+  #pragma GCC unroll 16
+  for (int r = 0; r < SIMD_R; r++) {
+    v[r] = SIMD_ORDER(SIMD_LOAD((direct ? keys : buf) + r * SIMD_W));
+  }
+
+  SIMD_NAME(sortRegisters)(v);
+
+  #pragma GCC unroll 16
+  for (int r = 0; r < SIMD_R; r++) {
+    SIMD_STORE((direct ? keys : buf) + r * SIMD_W, SIMD_ORDER(v[r]));
+  }
+  if (!direct && ascending) {
+    memcpy(keys, buf, n * sizeof(SIMD_KEY));
+  } else if (!direct) { // the padding is at the end of the ascending keys
+    for (long i = 0; i < n; i++) {
+      keys[i] = buf[n - 1 - i];
+    }
+  }
+}
+
+/**
+ * @brief Merges two sorted registers, the first keys of the two are left in lo and the last ones in hi.
+ */
+__attribute__((target(SIMD_TARGET), always_inline)) static inline void SIMD_NAME(mergeRegisters)(SIMD_V *lo, SIMD_V *hi, int ascending) {
+  SIMD_V b = SIMD_PERMUTE(*hi, SIMD_REVERSE_INDEX), l, h;
+  SIMD_MINMAX(*lo, b, l, h);
+  *lo = SIMD_NAME(mergeLanes)(ascending ? l : h, ascending);
+  *hi = SIMD_NAME(mergeLanes)(ascending ? h : l, ascending);
+}
+
+/**
+ * @brief Branchless two way merge, the run to take from is picked with a conditional move.
+ */
+static inline SIMD_KEY *SIMD_NAME(mergeScalar)(const SIMD_KEY *a, long na, const SIMD_KEY *b, long nb, SIMD_KEY *out, int ascending) {
+  long i = 0, j = 0;
+  while (i < na && j < nb) {
+    SIMD_KEY x = a[i], y = b[j];
+    int from_b = ascending ? y < x : y > x; // ties take the key of the first run
+    *out++ = from_b ? y : x;
+    j += from_b;
+    i += !from_b;
+  }
+  memcpy(out, a + i, (na - i) * sizeof(SIMD_KEY));
+  out += na - i;
+  memcpy(out, b + j, (nb - j) * sizeof(SIMD_KEY));
+  return out + nb - j;
+}
+
+/**
+ * @brief Merges two sorted runs into out, SIMD_W keys per step.
+ *
+ * The last SIMD_W keys merged so far are kept in a register and merged with the next
+ * SIMD_W keys of the run whose next key goes first, the first SIMD_W keys of the two are stored.
+ * When that run has less than SIMD_W keys left, the register and both rests are merged by scalar code.
+ */
+__attribute__((target(SIMD_TARGET), always_inline)) static inline void SIMD_NAME(mergeRunsDir)(const SIMD_KEY *a, long na, const SIMD_KEY *b, long nb, SIMD_KEY *out, int ascending) {
+  if (na < SIMD_W || nb < SIMD_W) {
+    SIMD_NAME(mergeScalar)(a, na, b, nb, out, ascending);
+    return;
+  }
+
+  SIMD_V lo = SIMD_ORDER(SIMD_LOAD(a)), hi = SIMD_ORDER(SIMD_LOAD(b));
+  long i = SIMD_W, j = SIMD_W;
+  int from_b;
+  while (1) {
+    SIMD_NAME(mergeRegisters)(&lo, &hi, ascending);
+    SIMD_STORE(out, SIMD_ORDER(lo));
+    out += SIMD_W;
+
+    from_b = i == na || (j < nb && (ascending ? b[j] < a[i] : b[j] > a[i]));
+    if (from_b ? nb - j < SIMD_W : na - i < SIMD_W)
+      break;
+    if (from_b) {
+      lo = SIMD_ORDER(SIMD_LOAD(b + j));
+      j += SIMD_W;
+    } else {
+      lo = SIMD_ORDER(SIMD_LOAD(a + i));
+      i += SIMD_W;
+    }
+  }
+
+  // the short run is merged with the register first, both have less than SIMD_W keys
+  SIMD_KEY h[SIMD_W], t[2 * SIMD_W];
+  SIMD_STORE(h, SIMD_ORDER(hi));
+  if (from_b) {
+    SIMD_NAME(mergeScalar)(h, SIMD_W, b + j, nb - j, t, ascending);
+    SIMD_NAME(mergeScalar)(t, SIMD_W + nb - j, a + i, na - i, out, ascending);
+  } else {
+    SIMD_NAME(mergeScalar)(h, SIMD_W, a + i, na - i, t, ascending);
+    SIMD_NAME(mergeScalar)(t, SIMD_W + na - i, b + j, nb - j, out, ascending);
+  }
+}
+
+__attribute__((target(SIMD_TARGET))) static void SIMD_NAME(mergeRuns)(const SIMD_KEY *a, long na, const SIMD_KEY *b, long nb, SIMD_KEY *out, int ascending) {
+  if (ascending) {
+    SIMD_NAME(mergeRunsDir)(a, na, b, nb, out, 1);
+  } else {
+    SIMD_NAME(mergeRunsDir)(a, na, b, nb, out, 0);
+  }
+}
@@ -32,11 +32,10 @@ void printlnUTF8(union UTF8* utf8) {
 int nextFileUTF8(FILE* fd, union UTF8* utf) {
   utf->code = 0;
 
-  // read first byte
-  fread(&utf->bytes[3], 1, 1, fd);
+  // read first byte, a 0x00 byte is a character like any other
+  if (fread(&utf->bytes[3], 1, 1, fd) != 1)
+    return 0;
   uint8_t c = utf->bytes[3];
-  if (c == 0)
-    return -1;
 
   uint8_t n = 1;
 
@@ -227,14 +226,15 @@ int endOfPreviusWord(FILE* fd) {
   return 0;
 }
 
-int countBuffer(uint8_t* buf, int* words, int* consonants) {
+// counts the words of len bytes, buf is followed by 4 zero bytes so a sequence cut by the end reads as a delimiter
+int countBuffer(uint8_t* buf, long len, int* words, int* consonants) {
   union UTF8 utf;
   uint8_t letter[26] = {0};
   int inWord = 0, inConsonant = 0;
 
   // for each utf
-  int i = 0;
-  while (buf[i] != '\0') {
+  long i = 0;
+  while (i < len) {
     i += nextUTF8(&buf[i], &utf);
     removeAccentuation(&utf);
     /* printUTF8(&utf); */
@@ -264,4 +264,46 @@ int countBuffer(uint8_t* buf, int* words, int* consonants) {
   return 0;
 }
 
+// returns a bool, !zero if the character at p and the one before it are both part of a word
+int insideWord(uint8_t* buf, long p) {
+  union UTF8 utf;
+  if (p == 0)
+    return 0;
+
+  nextUTF8(&buf[p], &utf);
+  removeAccentuation(&utf);
+  if (!isWordLetter(&utf) && !isMergerLetter(&utf))
+    return 0;
+
+  long prev = p - 1;
+  while (prev > 0 && p - prev < 4 && (buf[prev] & 0b11000000) == 0b10000000)
+    prev--;
+  nextUTF8(&buf[prev], &utf);
+  removeAccentuation(&utf);
+  return isWordLetter(&utf) || isMergerLetter(&utf);
+}
+
+// end of the block of a file (in memory) that starts at start: the last character boundary
+// at most blockSize bytes after start that is not inside a word; a word longer than a
+// block is not split, the block goes on to its end
+long blockEnd(uint8_t* buf, long len, long start, long blockSize) {
+  union UTF8 utf;
+  long p = start + blockSize;
+  if (p >= len)
+    return len;
+
+  while (p > start && (buf[p] & 0b11000000) == 0b10000000)
+    p--;
+  for (long q = p; q > start; q--) {
+    if ((buf[q] & 0b11000000) != 0b10000000 && !insideWord(buf, q))
+      return q;
+  }
+
+  if (p == start)
+    p += nextUTF8(&buf[p], &utf);
+  while (p < len && insideWord(buf, p))
+    p += nextUTF8(&buf[p], &utf);
+  return p < len ? p : len;
+}
+
 #endif  // !UTF8_H
@@ -1,25 +1,35 @@
+#include <fcntl.h>
 #include <math.h>
 #include <mpi.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 
 #include "./UTF8.h"
-#include "mpi_proto.h"
+#include "../../assig1/01/match.h"
 
 #define BLOCK_SIZE 4096
 // #define BLOCK_SIZE 256
 #define False 0
 #define True !False
 
-struct Node {
+#define PADDING 4  // zero bytes after every buffer, a sequence cut by the end never reads past it
+
+/*
+ * descriptor of a block, it points into the buffer of its file; all the
+ * descriptors live in one arena in file order, which is also the order they
+ * are handed out in
+ */
+struct Block {
   int file;
-  uint8_t block[BLOCK_SIZE + 1];
-  int startPos;
-  int endPos;
-  struct Node* next;
+  long startPos;
+  long endPos;
+  long len;  // bytes sent, in pattern mode the block is followed by the bytes a match starting in it may need
 };
 
 struct FileCounter {
@@ -38,82 +48,141 @@ static double get_delta_time(void) {
          1.0e-9 * (double)(t1.tv_nsec - t0.tv_nsec);
 }
 
-int min(int a, int b) {
+long min(long a, long b) {
   return a < b ? a : b;
 }
 
+// bytes of the mapping of a file of len bytes, whole pages with room for the padding
+static long mappedSize(long len) {
+  long page = sysconf(_SC_PAGESIZE);
+  return (len + PADDING + page - 1) / page * page;
+}
+
+/*
+ * maps a file read-only, followed by at least PADDING zero bytes; NULL if it can not be opened
+ * the pages are read on demand, the inputs do not have to fit in memory
+ */
+static uint8_t* mapFile(const char* name, long* len) {
+  struct stat st;
+  int fd = open(name, O_RDONLY);
+  if (fd == -1)
+    return NULL;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return NULL;
+  }
+  *len = st.st_size;
+
+  // anonymous zero pages hold the padding, the file is mapped over their start
+  uint8_t* data = (uint8_t*)mmap(NULL, mappedSize(*len), PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (data != MAP_FAILED && *len > 0 && mmap(data, *len, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    munmap(data, mappedSize(*len));
+    data = MAP_FAILED;
+  }
+  close(fd);
+  if (data == MAP_FAILED)
+    return NULL;
+  madvise(data, *len, MADV_SEQUENTIAL);
+  return data;
+}
+
+/*
+ * build: mpicc -Wall -O3 -o main main.c ../../assig1/01/match.c
+ * run:   mpiexec -n 4 ./main [-c block size] [-p literal]... <file>...
+ * with -p the lines with a match and the occurrences of each literal are counted instead of the words
+ */
 int main(int argc, char* argv[]) {
   int rank, nProc, nProcNow;
+  int blockSize = BLOCK_SIZE;
+  char* patterns[MAX_PATTERNS];
+  int patterns_c = 0;
+  int opt;
 
   MPI_Init(&argc, &argv);
   MPI_Comm_rank(MPI_COMM_WORLD, &rank);
   MPI_Comm_size(MPI_COMM_WORLD, &nProc);
   nProcNow = nProc;
 
+  // -c <bytes> overrides the block size, -p adds a literal, every rank parses them
+  while ((opt = getopt(argc, argv, "c:p:")) != -1) {
+    if (opt == 'c' && atoi(optarg) > 1) {
+      blockSize = atoi(optarg);
+    } else if (opt == 'p' && patterns_c < MAX_PATTERNS) {
+      patterns[patterns_c++] = optarg;
+    } else {
+      if (rank == 0)
+        fprintf(stderr, "Usage: %s [-c block size] [-p literal]... <file>...\n", argv[0]);
+      MPI_Finalize();
+      return EXIT_FAILURE;
+    }
+  }
+  struct matcher* matcher = NULL;
+  if (patterns_c > 0) {
+    matcher = buildMatcher(patterns, patterns_c);
+    if (matcher == NULL) {
+      if (rank == 0)
+        fprintf(stderr, "Invalid patterns: they must be distinct, not empty and without newlines\n");
+      MPI_Finalize();
+      return EXIT_FAILURE;
+    }
+  }
+  int fields = matcher != NULL ? MATCH_FIELDS(patterns_c) : 0;
+  int lookahead = matcher != NULL ? matcher->max_length - 1 : 0;
+
+  int files_c = argc - optind;
+
   if (rank == 0) {
     get_delta_time();
 
-    struct Node *head = NULL, *tail = NULL;
-    char* files[argc - 1];
+    char* files[files_c];
+    uint8_t* data[files_c];  // whole file, mapped, the blocks are sent straight from it
+    long data_len[files_c];
 
     // store files
-    for (int i = 0; i < argc - 1; i++) {
-      files[i] = argv[i + 1];
+    for (int i = 0; i < files_c; i++) {
+      files[i] = argv[optind + i];
     }
 
-    for (int i = 0; i < argc - 1; i++) {
-      FILE* fd = fopen(files[i], "rb");
-      if (fd == NULL) {
+    // one arena of descriptors for all the files, next is the first block not handed out yet
+    long blocks_c = 0, blocks_max = 1024, next = 0;
+    struct Block* blocks = (struct Block*)malloc(blocks_max * sizeof(struct Block));
+
+    for (int i = 0; i < files_c; i++) {
+      data[i] = mapFile(files[i], &data_len[i]);
+      if (data[i] == NULL) {
         printf("ERROR opening file: %s\n", files[i]);
         continue;
       }
-      fseek(fd, 0, SEEK_END);
-      int fd_len = ftell(fd);
-      fseek(fd, 0, SEEK_SET);
+      long fd_len = data_len[i];
 
-      int blockStart, blockEnd;
+      long blockStart = 0, blockEnd_;
       do {
-        // read next 4k utf8s and iterate from the end till the first delimiter
-        blockStart = ftell(fd);
-        blockEnd = min(blockStart + BLOCK_SIZE - 1, fd_len);  // -1 because there is required space for the \0
-        fseek(fd, blockEnd, SEEK_SET);
-        endOfPreviusWord(fd);
-        blockEnd = ftell(fd);
-
-        // read the block from the file system to the memory
-        struct Node* node = (struct Node*)malloc(sizeof(struct Node));
-        node->startPos = blockStart;
-        node->endPos = blockEnd;
-        node->file = i;
-        node->next = NULL;
-        fseek(fd, blockStart, SEEK_SET);
-        for (int i = 0; i < BLOCK_SIZE + 1; i++) {
-          node->block[i] = '\0';
-        }
-        fread(node->block, 1, blockEnd - blockStart, fd);
-        node->block[blockEnd - blockStart + 1] = '\0';
+        // the block ends at a word boundary (or at the end of a word longer than a block)
+        blockEnd_ = blockEnd(data[i], fd_len, blockStart, blockSize);
 
-        // save it in the next node to be further sent to a worker
-        if (tail == NULL) {
-          head = tail = node;
-        } else {
-          head->next = node;
-          head = node;
+        if (blocks_c == blocks_max) {
+          blocks_max *= 2;
+          blocks = (struct Block*)realloc(blocks, blocks_max * sizeof(struct Block));
         }
-
-        // wait for next worker request and send him the block calculated
-      } while (fd_len > blockStart + BLOCK_SIZE);
-
-      fclose(fd);
+        blocks[blocks_c].file = i;
+        blocks[blocks_c].startPos = blockStart;
+        blocks[blocks_c].endPos = blockEnd_;
+        blocks[blocks_c].len = min(blockEnd_ + lookahead, fd_len) - blockStart;
+        blocks_c++;
+
+        blockStart = blockEnd_;
+      } while (blockStart < fd_len);
     }
 
-    struct Node* onProc[nProc];
+    long onProc[nProc];  // block each worker is counting
 
-    struct FileCounter fileCounter[argc - 1];
-    for (int i = 0; i < argc - 1; i++) {
+    struct FileCounter fileCounter[files_c];
+    for (int i = 0; i < files_c; i++) {
       fileCounter[i].words = 0;
       fileCounter[i].consonants = 0;
     }
+    long* fileMatches = (long*)calloc((long)files_c * fields + 1, sizeof(long));
+    long* blockMatches = (long*)malloc((blocks_c * fields + 1) * sizeof(long));  // pattern mode counts of each block
 
     MPI_Request requestWorkers;
     MPI_Request request;
@@ -131,23 +200,29 @@ int main(int argc, char* argv[]) {
           sleep(1);
           continue;
 
-        } else if (worker_ack == 0 && tail == NULL) {
+        } else if (worker_ack == 0 && next == blocks_c) {
           ack = 0;
           MPI_Isend(&ack, 1, MPI_INT, status.MPI_SOURCE, 0, MPI_COMM_WORLD, &requestWorkers);
           nProcNow--;
 
-        } else if (worker_ack == 0 && tail != NULL) {
+        } else if (worker_ack == 0 && next < blocks_c) {
+          struct Block* block = &blocks[next];
           ack = 1;
           MPI_Isend(&ack, 1, MPI_INT, status.MPI_SOURCE, 0, MPI_COMM_WORLD, &requestWorkers);
-          onProc[status.MPI_SOURCE] = tail;
-          MPI_Isend(&tail->block, BLOCK_SIZE, MPI_CHAR, status.MPI_SOURCE, 0, MPI_COMM_WORLD, &requestWorkers);
-          tail = tail->next;
+          onProc[status.MPI_SOURCE] = next++;
+          // the block length goes first, in pattern mode the bytes sent also have the lookahead
+          long blockLen = block->endPos - block->startPos;
+          MPI_Send(&blockLen, 1, MPI_LONG, status.MPI_SOURCE, 0, MPI_COMM_WORLD);
+          MPI_Isend(data[block->file] + block->startPos, block->len, MPI_CHAR, status.MPI_SOURCE, 0, MPI_COMM_WORLD, &requestWorkers);
+
+        } else if (worker_ack == 1 && matcher != NULL) {
+          MPI_Recv(blockMatches + onProc[status.MPI_SOURCE] * fields, fields, MPI_LONG, status.MPI_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
         } else if (worker_ack == 1) {
           struct FileCounter workerData;
           MPI_Recv((char*)&workerData, sizeof(struct FileCounter), MPI_BYTE, status.MPI_SOURCE, 0, MPI_COMM_WORLD, MPI_STATUS_IGNORE);
 
-          int file_idx = onProc[status.MPI_SOURCE]->file;
+          int file_idx = blocks[onProc[status.MPI_SOURCE]].file;
           fileCounter[file_idx].words += workerData.words;
           fileCounter[file_idx].consonants += workerData.consonants;
         } else {
@@ -163,17 +238,42 @@ int main(int argc, char* argv[]) {
 
     MPI_Wait(&request, &status);
 
-    for (int i = 0; i < argc - 1; i++) {
-      printf("\nFile Name: %s\n", argv[i + 1]);
-      printf("Total Number of Words = %d\n", fileCounter[i].words);
-      printf("Total number of words with at least two instances of the same consonant = %d\n", fileCounter[i].consonants);
+    if (matcher != NULL) {
+      // the blocks are in file order, the lines that cross blocks are joined here
+      for (long b = 0; b < blocks_c; b++) {
+        mergeMatches(matcher, fileMatches + (long)blocks[b].file * fields, blockMatches + b * fields);
+      }
+      for (int i = 0; i < files_c; i++) {
+        long* counts = fileMatches + (long)i * fields;
+        finishMatches(counts);
+        printf("\nFile Name: %s\n", files[i]);
+        printf("Number of lines with a match = %ld\n", counts[MATCH_LINES]);
+        for (int k = 0; k < patterns_c; k++) {
+          printf("Occurrences of \"%s\" = %ld\n", patterns[k], counts[MATCH_OCCURRENCES + k]);
+        }
+      }
+    } else {
+      for (int i = 0; i < files_c; i++) {
+        printf("\nFile Name: %s\n", files[i]);
+        printf("Total Number of Words = %d\n", fileCounter[i].words);
+        printf("Total number of words with at least two instances of the same consonant = %d\n", fileCounter[i].consonants);
+      }
+    }
+    free(fileMatches);
+    free(blockMatches);
+    free(blocks);
+    for (int i = 0; i < files_c; i++) {
+      if (data[i] != NULL)
+        munmap(data[i], mappedSize(data_len[i]));
     }
     printf("\nTime: %fs", get_delta_time());
 
   } else {
     MPI_Status status;
     int n = 0;
-    uint8_t buf[BLOCK_SIZE];
+    int bufSize = blockSize + lookahead + PADDING;  // grows for words longer than a block
+    uint8_t* buf = (uint8_t*)malloc(bufSize);
+    long* matches = (long*)malloc((fields + 1) * sizeof(long));
 
     while (1) {
       n = 0;
@@ -182,16 +282,36 @@ int main(int argc, char* argv[]) {
       if (n == 0) {
         break;  // end process
 
-      } else if (n == 1) {  // calculate new block
-        MPI_Recv(buf, BLOCK_SIZE, MPI_CHAR, 0, 0, MPI_COMM_WORLD, &status);
-        struct FileCounter workerData = {0, 0};
-        countBuffer(buf, &workerData.words, &workerData.consonants);
+      } else if (n == 1) {  // count a new block
+        long blockLen;
+        int len;
+        MPI_Recv(&blockLen, 1, MPI_LONG, 0, 0, MPI_COMM_WORLD, &status);
+        MPI_Probe(0, 0, MPI_COMM_WORLD, &status);
+        MPI_Get_count(&status, MPI_CHAR, &len);
+        if (len + PADDING > bufSize) {
+          bufSize = len + PADDING;
+          buf = (uint8_t*)realloc(buf, bufSize);
+        }
+        MPI_Recv(buf, len, MPI_CHAR, 0, 0, MPI_COMM_WORLD, &status);
+        memset(buf + len, 0, PADDING);
+
         n = 1;
-        MPI_Send(&n, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
-        MPI_Send((char*)&workerData, sizeof(struct FileCounter), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+        if (matcher != NULL) {
+          matchChunk(matcher, buf, blockLen, len, matches);
+          MPI_Send(&n, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+          MPI_Send(matches, fields, MPI_LONG, 0, 0, MPI_COMM_WORLD);
+        } else {
+          struct FileCounter workerData = {0, 0};
+          countBuffer(buf, len, &workerData.words, &workerData.consonants);
+          MPI_Send(&n, 1, MPI_INT, 0, 0, MPI_COMM_WORLD);
+          MPI_Send((char*)&workerData, sizeof(struct FileCounter), MPI_BYTE, 0, 0, MPI_COMM_WORLD);
+        }
       }
     }
+    free(buf);
+    free(matches);
   }
+  freeMatcher(matcher);
 
   MPI_Finalize();
 
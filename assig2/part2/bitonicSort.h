@@ -12,7 +12,7 @@ extern void swap(int *a, int *b);
 extern void compareAndSwap(int sequence[], int i, int j, int direction);
 
 /**
- * @brief Sorts a sequence of integers using the Bitonic sort algorithm.
+ * @brief Sorts a sequence of integers using the Bitonic sort algorithm, of any size.
  *
  * @param sequence The array of integers to be sorted.
  * @param n The number of elements in the sequence.
@@ -22,6 +22,7 @@ extern void bitonicSort(int sequence[], int n, int direction);
 
 /**
  * @brief Merges a sequence of integers using the Bitonic merge operation.
+ * The sequence is made of two sorted halves, the first one with n / 2 elements.
  *
  * @param sequence The array of integers to be merged.
  * @param n The number of elements in the sequence.
@@ -0,0 +1,95 @@
+#include "distributedSort.h"
+#include "../../assig1/02/typed_sort.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Keeps in out the m smallest elements of the ascending blocks a and b, in ascending order.
+ */
+static void mergeLow(const int *a, const int *b, int m, int *out) {
+  int i = 0, j = 0;
+  for (int k = 0; k < m; k++) {
+    int fromB = b[j] < a[i];
+    out[k] = fromB ? b[j] : a[i];
+    j += fromB;
+    i += !fromB;
+  }
+}
+
+/**
+ * @brief Keeps in out the m greatest elements of the ascending blocks a and b, in ascending order.
+ */
+static void mergeHigh(const int *a, const int *b, int m, int *out) {
+  int i = m - 1, j = m - 1;
+  for (int k = m - 1; k >= 0; k--) {
+    int fromB = b[j] > a[i];
+    out[k] = fromB ? b[j] : a[i];
+    j -= fromB;
+    i -= !fromB;
+  }
+}
+
+void distributedBitonicSort(int *block, int m, int direction, MPI_Comm comm) {
+  int rank, numProc;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &numProc);
+
+  int *other = (int *)malloc((m + 1) * sizeof(int));
+  int *merged = (int *)malloc((m + 1) * sizeof(int));
+
+  // The blocks stay ascending, the network over the processes puts them in the direction
+  mergeSort_i32_asc(block, m, merged);
+
+  for (int k = 2; k <= numProc; k *= 2) {
+    for (int j = k / 2; j > 0; j /= 2) {
+      int partner = rank ^ j;
+      int up = ((rank & k) == 0) == (direction == 0);
+
+      // Only the block of the partner is received, memory stays at 3 blocks per process
+      MPI_Sendrecv(block, m, MPI_INT, partner, k, other, m, MPI_INT, partner, k, comm, MPI_STATUS_IGNORE);
+      if ((rank < partner) == up) {
+        if (m > 0 && block[m - 1] <= other[0]) {
+          continue; // already the lower half
+        }
+        mergeLow(block, other, m, merged);
+      } else {
+        if (m > 0 && block[0] >= other[m - 1]) {
+          continue; // already the upper half
+        }
+        mergeHigh(block, other, m, merged);
+      }
+      memcpy(block, merged, m * sizeof(int));
+    }
+  }
+
+  if (direction != 0) { // the processes are in descending order, their blocks too
+    for (int i = 0, j = m - 1; i < j; i++, j--) {
+      int t = block[i];
+      block[i] = block[j];
+      block[j] = t;
+    }
+  }
+
+  free(other);
+  free(merged);
+}
+
+int distributedIsSorted(const int *block, int n, int direction, MPI_Comm comm) {
+  int rank, numProc;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &numProc);
+
+  int sorted = direction == 0 ? isSorted_i32_asc(block, n) : isSorted_i32_desc(block, n);
+
+  // The first element of the next process, the blocks that are empty are the last ones
+  int first[2] = {n > 0, n > 0 ? block[0] : 0}, next[2] = {0, 0};
+  int prevRank = rank > 0 ? rank - 1 : MPI_PROC_NULL, nextRank = rank < numProc - 1 ? rank + 1 : MPI_PROC_NULL;
+  MPI_Sendrecv(first, 2, MPI_INT, prevRank, 0, next, 2, MPI_INT, nextRank, 0, comm, MPI_STATUS_IGNORE);
+  if (n > 0 && next[0]) {
+    sorted &= direction == 0 ? block[n - 1] <= next[1] : block[n - 1] >= next[1];
+  }
+
+  int allSorted;
+  MPI_Allreduce(&sorted, &allSorted, 1, MPI_INT, MPI_LAND, comm);
+  return allSorted;
+}
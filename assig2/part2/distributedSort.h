@@ -0,0 +1,33 @@
+#ifndef DISTRIBUTEDSORT_H
+#define DISTRIBUTEDSORT_H
+
+#include <mpi.h>
+
+/**
+ * @brief Sorts a sequence spread in blocks of the same size over a power of 2 of processes with the bitonic network.
+ *
+ * Every process only holds its block: the network runs over processes, each compare and swap of
+ * two processes is a compare-split, they exchange their blocks with MPI_Sendrecv and one keeps the
+ * lower half of the two and the other the upper half.
+ * Afterwards the elements of process p all go before the ones of process p + 1.
+ *
+ * @param block The elements of this process.
+ * @param m The number of elements of every process.
+ * @param direction The sorting direction, 0 for ascending and 1 for descending.
+ * @param comm The communicator of the processes.
+ */
+extern void distributedBitonicSort(int *block, int m, int direction, MPI_Comm comm);
+
+/**
+ * @brief Verifies if a sequence spread over the processes is sorted, each process checks its block
+ * and the first element of the next process. The empty blocks must be the last ones.
+ *
+ * @param block The elements of this process.
+ * @param n The number of elements of this process.
+ * @param direction The expected direction, 0 for ascending and 1 for descending.
+ * @param comm The communicator of the processes.
+ * @return 1 on every process if the sequence is sorted in the given direction, 0 otherwise.
+ */
+extern int distributedIsSorted(const int *block, int n, int direction, MPI_Comm comm);
+
+#endif
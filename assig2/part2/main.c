@@ -1,16 +1,27 @@
 /* USAGE: 
-mpicc -Wall -O3 -o out main.c readFile.c bitonicSort.c
+mpicc -Wall -O3 -o out main.c readFile.c bitonicSort.c sampleSort.c distributedSort.c
 mpiexec -n 8 ./out -d 1 dataset2/datSeq16M.bin
+mpiexec -n 6 ./out -e sample dataset2/datSeq16M.bin
+mpiexec -n 8 ./out -e distributed dataset2/datSeq16M.bin
+mpiexec -n 6 ./out -e sample -p -o sorted.bin dataset2/datSeq16M.bin
 */
 #include <stdio.h>
 #include <mpi.h>
 #include <stdlib.h>
+#include <string.h>
 #include <libgen.h>
 #include <unistd.h>
 #include <time.h>
 #include <math.h>
+#include <limits.h>
 #include "readFile.h"
 #include "bitonicSort.h"
+#include "sampleSort.h"
+#include "distributedSort.h"
+
+#define ENGINE_BITONIC 0 // merge tree of bitonic merges, a power of 2 of processes
+#define ENGINE_SAMPLE 1  // sample sort, any number of processes
+#define ENGINE_DISTRIBUTED 2 // bitonic network over processes that only hold their block, a power of 2 of processes
 
 /**
  * @brief A structure to hold a sequence's direction and size.
@@ -18,6 +29,8 @@ mpiexec -n 8 ./out -d 1 dataset2/datSeq16M.bin
 struct Seq {
   int direction; // 0 for ascending order, 1 for descending order
   int size; // size of the sequence
+  int engine; // ENGINE_BITONIC, ENGINE_SAMPLE or ENGINE_DISTRIBUTED
+  int parallelIO; // 1 if every process reads (and writes) its part of the file, 0 if rank 0 scatters (and gathers) it
 };
 
 /**
@@ -28,6 +41,9 @@ struct Seq {
 static void help (char *cmdName) {
   fprintf (stderr, "OPTIONS:\n"
             "  -d      --- direction (0 for ascending || 1 for descending) \n"
+            "  -e      --- engine (bitonic || sample || distributed) \n"
+            "  -p      --- every process reads its part of the file (sample, always on with distributed) \n"
+            "  -o      --- file to write the sorted sequence to \n"
             "  -h      --- print this help\n");
 }
 
@@ -66,20 +82,51 @@ int verifySequenceCorrectness(const int *sequence, int size, int direction) {
   return 1;
 }
 
+/**
+ * @brief Splits a sequence between processes, halving it at each level of the merge tree.
+ *
+ * The sizes of a level with parts processes are the halves of the sizes of the level with
+ * parts / 2, so every process merges two sorted halves and the first one has size / 2 elements.
+ *
+ * @param size The number of elements to split.
+ * @param parts The number of processes (a power of 2).
+ * @param counts The number of elements of each process.
+ * @param displs The offset of the elements of each process.
+ */
+void splitSequence(int size, int parts, int *counts, int *displs) {
+  if (parts == 1) {
+    counts[0] = size;
+    displs[0] = 0;
+    return;
+  }
+  splitSequence(size / 2, parts / 2, counts, displs);
+  splitSequence(size - size / 2, parts / 2, counts + parts / 2, displs);
+  displs[0] = 0;
+  for (int p = 1; p < parts; p++) {
+    displs[p] = displs[p - 1] + counts[p - 1];
+  }
+}
+
 /**
  * @brief Processes the command line arguments.
  *
  * @param argc The number of arguments.
  * @param argv The arguments.
  * @param direction The sorting direction.
+ * @param engine The sorting engine.
+ * @param parallelIO Set if every process reads its part of the file.
  * @param fileName The name of the file to read the sequence from.
+ * @param outFileName The name of the file to write the sorted sequence to, or NULL.
  */
-void process_command_line(int argc, char *argv[], int *direction, char **fileName) {
+void process_command_line(int argc, char *argv[], int *direction, int *engine, int *parallelIO, char **fileName, char **outFileName) {
   int opt;
   *direction = 0;
+  *engine = ENGINE_BITONIC;
+  *parallelIO = 0;
+  *outFileName = NULL;
 
   do { 
-    switch ((opt = getopt (argc, argv, "d:h"))) {
+    switch ((opt = getopt (argc, argv, "d:e:o:ph"))) {
       case 'd':
         if (atoi(optarg) != 0 && atoi(optarg) != 1) {
           fprintf(stderr, "%s: invalid sort direction\n", basename(argv[0]));
@@ -89,6 +136,28 @@ void process_command_line(int argc, char *argv[], int *direction, char **fileNam
         *direction = (int) atoi (optarg);
         break;
 
+      case 'e':
+        if (strcmp(optarg, "bitonic") == 0) {
+          *engine = ENGINE_BITONIC;
+        } else if (strcmp(optarg, "sample") == 0) {
+          *engine = ENGINE_SAMPLE;
+        } else if (strcmp(optarg, "distributed") == 0) {
+          *engine = ENGINE_DISTRIBUTED;
+        } else {
+          fprintf(stderr, "%s: invalid engine\n", basename(argv[0]));
+          help(basename(argv[0]));
+          exit(EXIT_FAILURE);
+        }
+        break;
+
+      case 'p':
+        *parallelIO = 1;
+        break;
+
+      case 'o':
+        *outFileName = optarg;
+        break;
+
       case 'h':
         help (basename (argv[0]));
         exit(EXIT_SUCCESS);
@@ -102,13 +171,174 @@ void process_command_line(int argc, char *argv[], int *direction, char **fileNam
     }
   } while (opt != -1);
 
-  if (argc < 4){ 
+  if (optind >= argc){ 
     fprintf (stderr, "Invalid format!\n");
     help (basename (argv[0]));
     exit(EXIT_FAILURE);
   }
 
   *fileName = argv[optind];
+
+  if (*engine == ENGINE_DISTRIBUTED) {
+    *parallelIO = 1;
+  } else if (*parallelIO && *engine == ENGINE_BITONIC) {
+    fprintf (stderr, "%s: the bitonic engine merges on rank 0, -p needs another engine\n", basename (argv[0]));
+    help (basename (argv[0]));
+    exit(EXIT_FAILURE);
+  }
+}
+
+/**
+ * @brief Sends a string of rank 0 to every process.
+ *
+ * @param str The string on rank 0, may be NULL. Set to a copy on the other processes.
+ */
+static void broadcastString(char **str, int rank) {
+  int length = rank == 0 && *str != NULL ? strlen(*str) + 1 : 0;
+
+  MPI_Bcast(&length, 1, MPI_INT, 0, MPI_COMM_WORLD);
+  if (length == 0) {
+    return;
+  }
+  if (rank != 0) {
+    *str = (char *) malloc(length);
+  }
+  MPI_Bcast(*str, length, MPI_CHAR, 0, MPI_COMM_WORLD);
+}
+
+/**
+ * @brief Sorts the sequence with sample sort, every process sorts an even share of it.
+ *
+ * @param seq The direction and size of the sequence.
+ * @param sequence The sequence, on rank 0 unless every process reads its part of the file.
+ * @param fileName The name of the file of the sequence.
+ * @param outFileName The name of the file to write the sorted sequence to, or NULL.
+ * @return The exit status of the process.
+ */
+static int sampleSortSequence(struct Seq *seq, int *sequence, char *fileName, char *outFileName, int rank, int numProc) {
+  int *counts = (int *) malloc(numProc * sizeof(int));
+  int *displs = (int *) malloc(numProc * sizeof(int));
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  if (rank == 0) {
+    get_delta_time();
+  }
+
+  for (int p = 0; p < numProc; p++) {
+    displs[p] = (long) seq->size * p / numProc;
+    counts[p] = (long) seq->size * (p + 1) / numProc - displs[p];
+  }
+  int size = counts[rank];
+  int *buf = (int *) malloc((size + 1) * sizeof(int));
+  if (seq->parallelIO) {
+    readBlock(fileName, displs[rank], size, buf, MPI_COMM_WORLD);
+  } else {
+    MPI_Scatterv(sequence, counts, displs, MPI_INT, buf, size, MPI_INT, 0, MPI_COMM_WORLD);
+  }
+
+  printf("Rank %d: Sorting %d elements\n", rank, size);
+  size = sampleSort(&buf, size, seq->direction, MPI_COMM_WORLD);
+  printf("Rank %d: Holds %d sorted elements\n", rank, size);
+
+  if (seq->parallelIO) {
+    // Every process writes its range after the ranges of the processes before it
+    int start = 0;
+    MPI_Exscan(&size, &start, 1, MPI_INT, MPI_SUM, MPI_COMM_WORLD);
+    if (rank == 0) {
+      start = 0;
+    }
+    int sorted = distributedIsSorted(buf, size, seq->direction, MPI_COMM_WORLD);
+    if (rank == 0) {
+      printf(sorted ? "Sorted!\n" : "Not Sorted!\n");
+      printf("Time to sample sort: %fs\n", get_delta_time());
+    }
+    if (outFileName != NULL) {
+      writeBlock(outFileName, seq->size, start, size, buf, MPI_COMM_WORLD);
+    }
+  } else {
+    // The ranges of the processes are in order, gathering them in rank order gives the sequence
+    MPI_Gather(&size, 1, MPI_INT, counts, 1, MPI_INT, 0, MPI_COMM_WORLD);
+    if (rank == 0) {
+      displs[0] = 0;
+      for (int p = 1; p < numProc; p++) {
+        displs[p] = displs[p - 1] + counts[p - 1];
+      }
+    }
+    MPI_Gatherv(buf, size, MPI_INT, sequence, counts, displs, MPI_INT, 0, MPI_COMM_WORLD);
+
+    if (rank == 0) {
+      if (verifySequenceCorrectness(sequence, seq->size, seq->direction)) {
+        printf("Sorted!\n");
+      } else {
+        printf("Not Sorted!\n");
+      }
+      printf("Time to sample sort: %fs\n", get_delta_time());
+      if (outFileName != NULL) {
+        writeBlock(outFileName, seq->size, 0, seq->size, sequence, MPI_COMM_SELF);
+      }
+    }
+  }
+
+  free(counts);
+  free(displs);
+  free(buf);
+  free(sequence);
+
+  MPI_Finalize();
+
+  return EXIT_SUCCESS;
+}
+
+/**
+ * @brief Sorts the sequence of a file with the bitonic network over processes, every process only
+ * reads and holds its block of the sequence.
+ *
+ * The last block is padded with elements that go after all the others, they end at the end of the
+ * sequence and are not part of it.
+ *
+ * @param seq The direction and size of the sequence.
+ * @param fileName The name of the file of the sequence.
+ * @param outFileName The name of the file to write the sorted sequence to, or NULL.
+ * @return The exit status of the process.
+ */
+static int distributedSortSequence(struct Seq *seq, char *fileName, char *outFileName, int rank, int numProc) {
+  int m = (seq->size + numProc - 1) / numProc;
+  int start = (long) m * rank < seq->size ? m * rank : seq->size;
+  int size = start + m < seq->size ? m : seq->size - start;
+  int *block = (int *) malloc((m + 1) * sizeof(int));
+
+  readBlock(fileName, start, size, block, MPI_COMM_WORLD);
+  for (int i = size; i < m; i++) {
+    block[i] = seq->direction == 0 ? INT_MAX : INT_MIN;
+  }
+
+  MPI_Barrier(MPI_COMM_WORLD);
+  if (rank == 0) {
+    get_delta_time();
+  }
+
+  printf("Rank %d: Sorting %d elements\n", rank, size);
+  distributedBitonicSort(block, m, seq->direction, MPI_COMM_WORLD);
+
+  // The padding went to the end of the sequence, so every block keeps as many elements as it read
+  int sorted = distributedIsSorted(block, size, seq->direction, MPI_COMM_WORLD);
+  if (rank == 0) {
+    if (sorted) {
+      printf("Sorted!\n");
+    } else {
+      printf("Not Sorted!\n");
+    }
+    printf("Time to distributed bitonic sort: %fs\n", get_delta_time());
+  }
+  if (outFileName != NULL) {
+    writeBlock(outFileName, seq->size, start, size, block, MPI_COMM_WORLD);
+  }
+
+  free(block);
+
+  MPI_Finalize();
+
+  return EXIT_SUCCESS;
 }
 
 int main(int argc, char *argv[]) {
@@ -121,33 +351,48 @@ int main(int argc, char *argv[]) {
   MPI_Group currentGroup, nextGroup;
   MPI_Comm currentComm, nextComm;
   int *sequence = NULL;
-
-  if ((numProc & (numProc - 1)) != 0) {
-    if (rank == 0) {
-      fprintf(stderr, "Number of processes must be 1 or a power of 2 (2,4,8)\n");
-    }
-    MPI_Finalize();
-    return EXIT_FAILURE;
-  }
+  char *fileName = NULL, *outFileName = NULL;
 
   if (rank == 0){
-    char* fileName;
-    int direction;
-    process_command_line(argc, argv, &direction, &fileName);
+    int direction, engine, parallelIO;
+    process_command_line(argc, argv, &direction, &engine, &parallelIO, &fileName, &outFileName);
 
     printf ("File: %s\n", fileName);
     printf ("%s Sorting...\n", direction == 0 ? "Ascending" : "Descending" );
 
-    int size = readSequence(fileName, &sequence);
+    // With parallel I/O every process reads its part, otherwise rank 0 scatters the sequence
+    int size = parallelIO ? readSequenceSize(fileName) : readSequence(fileName, &sequence);
 
     seq.direction = direction;
     seq.size = size;
+    seq.engine = engine;
+    seq.parallelIO = parallelIO;
 
     // Send to the other processes
-    MPI_Bcast(&seq, 1, MPI_2INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&seq, 4, MPI_INT, 0, MPI_COMM_WORLD);
   } else {
     // Receive from the other processes
-    MPI_Bcast(&seq, 1, MPI_2INT, 0, MPI_COMM_WORLD);
+    MPI_Bcast(&seq, 4, MPI_INT, 0, MPI_COMM_WORLD);
+  }
+
+  broadcastString(&fileName, rank);
+  broadcastString(&outFileName, rank);
+
+  if (seq.engine == ENGINE_SAMPLE) {
+    return sampleSortSequence(&seq, sequence, fileName, outFileName, rank, numProc);
+  }
+
+  if ((numProc & (numProc - 1)) != 0) {
+    if (rank == 0) {
+      fprintf(stderr, "Number of processes must be 1 or a power of 2 (2,4,8)\n");
+    }
+    free(sequence);
+    MPI_Finalize();
+    return EXIT_FAILURE;
+  }
+
+  if (seq.engine == ENGINE_DISTRIBUTED) {
+    return distributedSortSequence(&seq, fileName, outFileName, rank, numProc);
   }
 
   int *buf = (int *) malloc(seq.size * sizeof(int));
@@ -157,6 +402,7 @@ int main(int argc, char *argv[]) {
   int subsequenceSize = 0;
 
   int Group[8]; // 8 max number of processes
+  int counts[8], displs[8];
   int currentProc = numProc;
 
   // Create Communication Groups for the processes
@@ -188,10 +434,11 @@ int main(int argc, char *argv[]) {
     }
 
     MPI_Comm_size (currentComm, &numProc);
-    subsequenceSize = seq.size / currentProc;
+    splitSequence(seq.size, currentProc, counts, displs);
+    subsequenceSize = counts[rank];
 
-    // Distribute the sequence through the processes
-    MPI_Scatter(sequence, subsequenceSize, MPI_INT, buf, subsequenceSize, MPI_INT, 0, currentComm);
+    // Distribute the sequence through the processes, any size (the last elements are not dropped)
+    MPI_Scatterv(sequence, counts, displs, MPI_INT, buf, subsequenceSize, MPI_INT, 0, currentComm);
 
     // Sort subsequence
     if (i == 0) {
@@ -205,7 +452,7 @@ int main(int argc, char *argv[]) {
     // Wait for all processes to finish sorting
     MPI_Barrier(currentComm); 
 
-    MPI_Gather(buf, subsequenceSize, MPI_INT, sequence, subsequenceSize, MPI_INT, 0, currentComm);
+    MPI_Gatherv(buf, subsequenceSize, MPI_INT, sequence, counts, displs, MPI_INT, 0, currentComm);
     currentProc = numProc / 2;
   }
 
@@ -217,6 +464,9 @@ int main(int argc, char *argv[]) {
       printf("Not Sorted!\n");
     }
     printf("Time to bitonic sort: %fs\n", get_delta_time());
+    if (outFileName != NULL) {
+      writeBlock(outFileName, seq.size, 0, seq.size, sequence, MPI_COMM_SELF);
+    }
   }
 
   free(buf);
@@ -28,4 +28,86 @@ int readSequence(char *fileName, int **sequence) {
   fclose(file);
 
   return size;
+}
+
+/**
+ * @brief Reads the number of integers of a binary file.
+ *
+ * @param fileName The name of the file to read from.
+ * @return The number of integers of the file.
+ */
+int readSequenceSize(char *fileName) {
+  FILE *file = fopen(fileName, "rb");
+  if (file == NULL) {
+    fprintf(stderr, "Error: file not found\n");
+    exit(EXIT_FAILURE);
+  }
+
+  int size;
+  if(fread(&size, sizeof(int), 1, file) != 1) {
+    perror("Error reading file");
+    exit(EXIT_FAILURE);
+  }
+  fclose(file);
+
+  return size;
+}
+
+/**
+ * @brief Reads a block of the sequence of integers of a binary file, without reading the rest of it.
+ * Collective, every process of the communicator reads its block with MPI_File_read_at_all.
+ *
+ * @param fileName The name of the file to read from.
+ * @param start The position of the first integer of the block in the sequence.
+ * @param count The number of integers of the block.
+ * @param block An array of count integers to fill.
+ * @param comm The communicator of the processes.
+ */
+void readBlock(char *fileName, int start, int count, int *block, MPI_Comm comm) {
+  MPI_File file;
+  MPI_Status status;
+  int read;
+
+  if (MPI_File_open(comm, fileName, MPI_MODE_RDONLY, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    fprintf(stderr, "Error: file not found\n");
+    MPI_Abort(comm, EXIT_FAILURE);
+  }
+
+  // the sequence starts after its size
+  MPI_File_read_at_all(file, (MPI_Offset) (start + 1) * sizeof(int), block, count, MPI_INT, &status);
+  MPI_Get_count(&status, MPI_INT, &read);
+  if (read != count) {
+    fprintf(stderr, "Error reading file\n");
+    MPI_Abort(comm, EXIT_FAILURE);
+  }
+  MPI_File_close(&file);
+}
+
+/**
+ * @brief Writes a sequence of integers to a binary file in the format it is read, every process writes a block.
+ * Collective, every process of the communicator writes its block with MPI_File_write_at_all.
+ *
+ * @param fileName The name of the file to write to, it is created or replaced.
+ * @param size The number of integers of the whole sequence.
+ * @param start The position of the first integer of the block in the sequence.
+ * @param count The number of integers of the block.
+ * @param block The count integers of the block.
+ * @param comm The communicator of the processes.
+ */
+void writeBlock(char *fileName, int size, int start, int count, const int *block, MPI_Comm comm) {
+  MPI_File file;
+  int rank;
+  MPI_Comm_rank(comm, &rank);
+
+  if (MPI_File_open(comm, fileName, MPI_MODE_WRONLY | MPI_MODE_CREATE, MPI_INFO_NULL, &file) != MPI_SUCCESS) {
+    fprintf(stderr, "Error: cannot create file %s\n", fileName);
+    MPI_Abort(comm, EXIT_FAILURE);
+  }
+  MPI_File_set_size(file, (MPI_Offset) (size + 1) * sizeof(int));
+
+  if (rank == 0) {
+    MPI_File_write_at(file, 0, &size, 1, MPI_INT, MPI_STATUS_IGNORE);
+  }
+  MPI_File_write_at_all(file, (MPI_Offset) (start + 1) * sizeof(int), block, count, MPI_INT, MPI_STATUS_IGNORE);
+  MPI_File_close(&file);
 }
\ No newline at end of file
@@ -1,6 +1,8 @@
 #ifndef FILE_READER_H
 #define FILE_READER_H
 
+#include <mpi.h>
+
 /**
  * @brief Reads a sequence of integers from a binary file.
  *
@@ -10,4 +12,37 @@
  */
 int readSequence(char *fileName, int **sequence);
 
+/**
+ * @brief Reads the number of integers of a binary file.
+ *
+ * @param fileName The name of the file to read from.
+ * @return The number of integers of the file.
+ */
+int readSequenceSize(char *fileName);
+
+/**
+ * @brief Reads a block of the sequence of integers of a binary file, without reading the rest of it.
+ * Collective, every process of the communicator reads its block with MPI_File_read_at_all.
+ *
+ * @param fileName The name of the file to read from.
+ * @param start The position of the first integer of the block in the sequence.
+ * @param count The number of integers of the block.
+ * @param block An array of count integers to fill.
+ * @param comm The communicator of the processes.
+ */
+void readBlock(char *fileName, int start, int count, int *block, MPI_Comm comm);
+
+/**
+ * @brief Writes a sequence of integers to a binary file in the format it is read, every process writes a block.
+ * Collective, every process of the communicator writes its block with MPI_File_write_at_all.
+ *
+ * @param fileName The name of the file to write to, it is created or replaced.
+ * @param size The number of integers of the whole sequence.
+ * @param start The position of the first integer of the block in the sequence.
+ * @param count The number of integers of the block.
+ * @param block The count integers of the block.
+ * @param comm The communicator of the processes.
+ */
+void writeBlock(char *fileName, int size, int start, int count, const int *block, MPI_Comm comm);
+
 #endif
\ No newline at end of file
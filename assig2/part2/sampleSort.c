@@ -0,0 +1,152 @@
+#include "sampleSort.h"
+#include "../../assig1/02/typed_sort.h"
+#include <stdlib.h>
+#include <string.h>
+
+/**
+ * @brief Sorts n elements in a direction, 0 for ascending and 1 for descending.
+ *
+ * @param tmp n elements of scratch space.
+ */
+static void sortRun(int *sequence, int n, int direction, int *tmp) {
+  mergeSortKeys(sequence, n, SORT_KEY_i32, direction, tmp);
+}
+
+/**
+ * @brief Makes the scratch space hold at least n elements.
+ */
+static int *growScratch(int *scratch, int *scratchSize, int n) {
+  if (n > *scratchSize) {
+    *scratchSize = n;
+    scratch = (int *)realloc(scratch, (n + 1) * sizeof(int));
+  }
+  return scratch;
+}
+
+/**
+ * @brief The number of elements of a sorted run that go before or with a splitter.
+ */
+static int splitRun(const int *run, int n, int splitter, int direction) {
+  int lo = 0, hi = n;
+
+  while (lo < hi) {
+    int mid = lo + (hi - lo) / 2;
+    if (direction == 0 ? run[mid] <= splitter : run[mid] >= splitter) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo;
+}
+
+/**
+ * @brief Merges the sorted runs of a buffer, two at a time, until one is left.
+ *
+ * @param runStart The numRuns + 1 offsets of the runs.
+ * @param tmp Scratch space of the size of the buffer.
+ * @return The buffer left with the merged runs, sequence or tmp.
+ */
+static int *mergeRunsTree(int *sequence, int *tmp, const int *runStart, int numRuns, int direction) {
+  int *src = sequence, *dst = tmp;
+
+  for (int w = 1; w < numRuns; w *= 2) {
+    for (int p = 0; p < numRuns; p += 2 * w) {
+      int s = runStart[p];
+      int m = runStart[p + w < numRuns ? p + w : numRuns];
+      int e = runStart[p + 2 * w < numRuns ? p + 2 * w : numRuns];
+      if (direction == 0) {
+        mergeRuns_i32_asc(src + s, m - s, src + m, e - m, dst + s);
+      } else {
+        mergeRuns_i32_desc(src + s, m - s, src + m, e - m, dst + s);
+      }
+    }
+    int *t = src;
+    src = dst;
+    dst = t;
+  }
+  return src;
+}
+
+int sampleSort(int **sequence, int n, int direction, MPI_Comm comm) {
+  int rank, numProc;
+  MPI_Comm_rank(comm, &rank);
+  MPI_Comm_size(comm, &numProc);
+
+  // One scratch buffer for the local sort, the sample sort and the final merge
+  int scratchSize = n;
+  int *scratch = (int *)malloc((n + 1) * sizeof(int));
+
+  sortRun(*sequence, n, direction, scratch);
+  if (numProc == 1) {
+    free(scratch);
+    return n;
+  }
+
+  // Regular sample: numProc - 1 evenly spaced elements of every process
+  int numSamples = n > 0 ? numProc - 1 : 0;
+  int *samples = (int *)malloc((numProc - 1) * sizeof(int));
+  for (int i = 0; i < numSamples; i++) {
+    samples[i] = (*sequence)[(long)(i + 1) * n / numProc];
+  }
+
+  int *sampleCounts = (int *)malloc(numProc * sizeof(int));
+  int *sampleDispls = (int *)malloc(numProc * sizeof(int));
+  MPI_Allgather(&numSamples, 1, MPI_INT, sampleCounts, 1, MPI_INT, comm);
+  int totalSamples = 0;
+  for (int p = 0; p < numProc; p++) {
+    sampleDispls[p] = totalSamples;
+    totalSamples += sampleCounts[p];
+  }
+  int *allSamples = (int *)malloc((totalSamples + 1) * sizeof(int));
+  MPI_Allgatherv(samples, numSamples, MPI_INT, allSamples, sampleCounts, sampleDispls, MPI_INT, comm);
+
+  // Every process picks the same splitters, evenly spaced in the sorted sample
+  scratch = growScratch(scratch, &scratchSize, totalSamples);
+  sortRun(allSamples, totalSamples, direction, scratch);
+  int *sendCounts = (int *)malloc(numProc * sizeof(int));
+  int *sendDispls = (int *)malloc(numProc * sizeof(int));
+  int *recvCounts = (int *)malloc(numProc * sizeof(int));
+  int *recvDispls = (int *)malloc((numProc + 1) * sizeof(int));
+  int start = 0;
+  for (int p = 0; p < numProc; p++) {
+    int end = n;
+    if (p < numProc - 1 && totalSamples > 0) {
+      end = splitRun(*sequence, n, allSamples[(long)(p + 1) * totalSamples / numProc], direction);
+      if (end < start) {
+        end = start;
+      }
+    }
+    sendDispls[p] = start;
+    sendCounts[p] = end - start;
+    start = end;
+  }
+
+  // The elements cross the network once, to the process of their range
+  MPI_Alltoall(sendCounts, 1, MPI_INT, recvCounts, 1, MPI_INT, comm);
+  recvDispls[0] = 0;
+  for (int p = 0; p < numProc; p++) {
+    recvDispls[p + 1] = recvDispls[p] + recvCounts[p];
+  }
+  int size = recvDispls[numProc];
+  int *received = (int *)malloc((size + 1) * sizeof(int));
+  MPI_Alltoallv(*sequence, sendCounts, sendDispls, MPI_INT, received, recvCounts, recvDispls, MPI_INT, comm);
+
+  // Every process merges the sorted runs it received
+  free(*sequence);
+  scratch = growScratch(scratch, &scratchSize, size);
+  int *sorted = mergeRunsTree(received, scratch, recvDispls, numProc, direction);
+  free(sorted == received ? scratch : received);
+  *sequence = sorted;
+
+  free(samples);
+  free(sampleCounts);
+  free(sampleDispls);
+  free(allSamples);
+  free(sendCounts);
+  free(sendDispls);
+  free(recvCounts);
+  free(recvDispls);
+
+  return size;
+}
@@ -0,0 +1,22 @@
+#ifndef SAMPLESORT_H
+#define SAMPLESORT_H
+
+#include <mpi.h>
+
+/**
+ * @brief Sorts a sequence spread over the processes of a communicator with sample sort.
+ *
+ * Every process sorts its elements, the splitters are picked from a regular sample of all of them,
+ * the elements are sent to the process of their range with one all to all exchange and every
+ * process merges the sorted runs it receives.
+ * Afterwards the elements of process p all go before the ones of process p + 1.
+ *
+ * @param sequence The elements of this process, allocated with malloc. It is replaced by the sorted elements of this process.
+ * @param n The number of elements of this process.
+ * @param direction The sorting direction, 0 for ascending and 1 for descending.
+ * @param comm The communicator of the processes.
+ * @return The number of elements of this process after the sort.
+ */
+extern int sampleSort(int **sequence, int n, int direction, MPI_Comm comm);
+
+#endif
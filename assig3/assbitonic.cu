@@ -9,6 +9,7 @@
 #include <sys/types.h>
 #include <time.h>
 
+#include "../assig1/02/typed_sort.h"
 #include "common.h"
 #include <cuda_runtime.h>
 
@@ -202,6 +203,11 @@ static void sort_cpu_kernel(unsigned int *arr, unsigned int n) {
   uint kk;
   uint temp;
 
+  if ((n & (n - 1)) != 0) { // the loops below need a power of 2, this network pads virtually
+    bitonicSort_u32_asc(arr, n);
+    return;
+  }
+
   for (k = 2, kk = 1; k <= n; k *= 2, kk++) { // for each iteration
     // printf("ITER %d, %d subsequences\n", kk, k);
     for (j = k / 2; j >= 1; j /= 2) { // for each step
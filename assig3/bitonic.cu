@@ -6,6 +6,8 @@
 #include <sys/types.h>
 #include <time.h>
 
+#include "../assig1/02/typed_sort.h"
+
 __global__ void dev_mergesort(uint32_t *a, uint32_t *b, uint32_t arrayLen,
                               uint32_t step) {
   uint32_t index = blockIdx.x * blockDim.x + threadIdx.x;
@@ -64,11 +66,7 @@ __global__ void dev_bitonicsort1(uint32_t *n, uint32_t size, uint32_t step,
   uint32_t n1 = idj * j1 + imj;
   uint32_t n2 = idj * j1 + j1 - imj - 1;
 
-  if (n[n1] > n[n2]) {
-    uint32_t t = n[n1];
-    n[n1] = n[n2];
-    n[n2] = t;
-  }
+  compareAndSwap_u32_asc(&n[n1], &n[n2]);
 }
 
 __global__ void dev_bitonicsort2(uint32_t *n, uint32_t size, uint32_t step,
@@ -83,11 +81,7 @@ __global__ void dev_bitonicsort2(uint32_t *n, uint32_t size, uint32_t step,
   uint32_t n1 = (i / j) * j1 + i % j;
   uint32_t n2 = n1 + j;
 
-  if (n[n1] > n[n2]) {
-    uint32_t t = n[n1];
-    n[n1] = n[n2];
-    n[n2] = t;
-  }
+  compareAndSwap_u32_asc(&n[n1], &n[n2]);
 }
 
 void copynumbers(uint32_t *a, uint32_t *b, uint32_t len) {
@@ -96,14 +90,7 @@ void copynumbers(uint32_t *a, uint32_t *b, uint32_t len) {
   }
 }
 
-void caps(uint32_t *a, uint32_t *b) {
-  uint32_t temp;
-  if (*a > *b) {
-    temp = *a;
-    *a = *b;
-    *b = temp;
-  }
-}
+void caps(uint32_t *a, uint32_t *b) { compareAndSwap_u32_asc(a, b); }
 
 // dir is 1 for ascending and -1 for descending
 void caps(uint32_t *a, uint32_t *b, int dir) {
@@ -140,105 +127,54 @@ void host_bitonicsort2(uint32_t *numbers, uint32_t arrayLen) {
   printf("\n\n");
 }
 
-void host_bitonicsort(uint32_t *n, uint32_t size) {
-  uint i, j, k;
-  uint t_count = size / 2;
-  uint log2size = -1;
-  uint32_t a, b;
+// stage of blocks of j1 keys: each key of the first half against its mirror in the second,
+// then the half cleaners, the same pairs as dev_bitonicsort1 and dev_bitonicsort2
+void host_bitonicflip(uint32_t *n, uint32_t size, uint32_t j1) {
+  uint32_t j0 = j1 >> 1, a, b;
 
-  // calculate thread count
-  i = size;
-  while (i != 0) {
-    i >>= 1;
-    log2size++;
+  for (uint32_t i = 0; i < size / 2; i++) {
+    a = (i / j0) * j1 + i % j0;
+    b = (i / j0) * j1 + j1 - i % j0 - 1;
+    caps(&n[a], &n[b]);
   }
+  if (j0 > 1) {
+    bitonicMergeStrides_u32_asc(n, size, j0 >> 1, 1);
+  }
+}
 
-  uint32_t j0 = 1, j1 = 2, step = 0, jj0, jj1;
-  for (j = 1; j <= log2size; j++) {
-    for (i = 0; i < t_count; i++) {
-      a = (i / j0) * j1 + i % j0;
-      b = (i / j0) * j1 + j1 - i % j0 - 1;
-      // printf("( %d, %d)\n", a, b);
-      caps(&n[a], &n[b]);
-    }
-
-    // for (k = step; k > 0; k--) {
-    for (k = 1; k <= step; k++) {
-      for (i = 0; i < t_count; i++) {
-        jj0 = j0 >> k;
-        jj1 = j1 >> k;
-        a = (i / jj0) * jj1 + i % jj0;
-        b = a + jj0;
-        caps(&n[a], &n[b]);
-        // printf("_( %d, %d)\n", bah, bah + (j0 >> k));
-      }
-    }
+void host_bitonicsort(uint32_t *n, uint32_t size) {
+  uint32_t j1, k;
 
-    j0 <<= 1;
-    j1 <<= 1;
-    step += 1;
+  if ((size & (size - 1)) != 0) { // the loops below need a power of 2, this network pads virtually
+    bitonicSort_u32_asc(n, size);
+    return;
   }
-}
 
-void host_mergeSort(uint32_t *numbers, uint32_t arrayLen) {
-  uint32_t i, k;
-  uint32_t *ntemp = (uint32_t *)malloc(arrayLen * 4);
-
-  // second pass
-  uint32_t l, r, step, halfStep;
-  for (step = 2; step <= arrayLen; step <<= 1) {
-    halfStep = step >> 1;
-
-    for (i = 0; i < arrayLen; i += step) {
-      k = i;
-      l = i;
-      r = i + halfStep;
-      while (l < i + halfStep && r < i + step) {
-        if (numbers[l] < numbers[r]) {
-          ntemp[k] = numbers[l];
-          l++;
-        } else {
-          ntemp[k] = numbers[r];
-          r++;
-        }
-        k++;
-      }
-      while (l < i + halfStep) {
-        ntemp[k] = numbers[l];
-        l++;
-        k++;
-      }
-      while (r < i + step) {
-        ntemp[k] = numbers[r];
-        r++;
-        k++;
-      }
-    }
-    for (i = 0; i < arrayLen; i++) {
-      numbers[i] = ntemp[i];
+  // the stages of blocks up to a tile run on a tile before the next one, the longer ones keep
+  // their short strides inside a tile, so most strides find their keys in cache
+  uint32_t tile = SORT_TILE_BYTES / sizeof(uint32_t);
+  if (tile > size)
+    tile = size;
+
+  for (k = 0; k < size; k += tile) {
+    for (j1 = 2; j1 <= tile; j1 <<= 1) {
+      host_bitonicflip(n + k, tile, j1);
     }
   }
+  for (j1 = 2 * tile; j1 <= size; j1 <<= 1) {
+    host_bitonicflip(n, size, j1);
+  }
+}
 
-  free(ntemp);
+// tmp holds arrayLen keys of scratch space, the passes alternate between it and numbers
+void host_mergeSort(uint32_t *numbers, uint32_t arrayLen, uint32_t *tmp) {
+  mergeSort_u32_asc(numbers, arrayLen, tmp);
 }
 
+// the network of the wikipedia article, size a power of 2; the direction of a block of k keys
+// is (i & k) == 0 and the stages run tile by tile (see bitonicStages in typed_sort_body.h)
 void host_wikibitonicsort(uint32_t *n, uint32_t size) {
-  int k, j, i, l, t;
-
-  for (k = 2; k <= size; k *= 2) {
-    for (j = k / 2; j > 0; j /= 2) {
-      for (i = 0; i < size; i++) {
-        l = i ^ j;
-        if (l > i) {
-          if (((i & j) == 0 && n[i] > n[l]) || ((i & j) != 0 && n[i] < n[l])) {
-            t = n[i];
-            n[i] = n[l];
-            n[l] = t;
-          }
-        }
-      }
-    }
-  }
+  bitonicStages_u32_asc(n, size, 2);
 }
 
 int main(int argc, char *argv[]) {
@@ -309,9 +245,10 @@ int main(int argc, char *argv[]) {
   cudaMemcpy(numbers_dcopy, d_n, bytes, cudaMemcpyDeviceToHost);
 
   uint32_t *hostnumbers = (uint32_t *)malloc(arrayLen * sizeof(uint32_t));
+  uint32_t *hosttmp = (uint32_t *)malloc(arrayLen * sizeof(uint32_t)); // allocated before the clock starts
   copynumbers(hostnumbers, numbers, arrayLen);
   clk = clock();
-  host_mergeSort(hostnumbers, arrayLen);
+  host_mergeSort(hostnumbers, arrayLen, hosttmp);
   clk = clock() - clk;
   printf("Host Merge Sort: %fs\n", ((double)clk) / CLOCKS_PER_SEC);
 
@@ -341,6 +278,7 @@ int main(int argc, char *argv[]) {
 
   cudaFree(d_n);
   free(hostnumbers);
+  free(hosttmp);
   free(numbers);
 
   return 0;